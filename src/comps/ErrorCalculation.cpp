@@ -20,202 +20,195 @@ unique_ptr<ErrorCalculator> ErrorCalculator::create(ErrorMethod method) {
     }
 }
 
-// rgb channel
-unsigned char getChannelValue(const Pixel& pixel, int channel) {
-    switch (channel) {
-        case 0: return pixel.r;
-        case 1: return pixel.g;
-        case 2: return pixel.b;
-        default: return 0;
+// region checker
+bool ErrorCalculator::isValidRegion(const ImageView& image, int x, int y, int width, int height) const {
+    return x >= 0 && y >= 0 && width > 0 && height > 0 && x + width <= image.getWidth() && y + height <= image.getHeight();
+}
+
+// block moments from the shared statistics
+void ErrorCalculator::regionMoments(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out) const {
+    if (integralImage && integralImage->covers(x, y, width, height)) {
+        integralImage->getMoments(x, y, width, height, out);
+    } else {
+        ErrorKernels::blockMoments(image, x, y, width, height, out);
+    }
+}
+
+// truncated mean color
+Pixel ErrorCalculator::meanColor(const ChannelMoments& moments) {
+    if (moments.count == 0) {
+        return Pixel(0, 0, 0);
     }
+    return Pixel(
+        static_cast<unsigned char>(moments.sum[0] / moments.count),
+        static_cast<unsigned char>(moments.sum[1] / moments.count),
+        static_cast<unsigned char>(moments.sum[2] / moments.count)
+    );
+}
+
+// generic region stats, metrics without shared statistics pay one extra sweep
+RegionStats ErrorCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    ChannelMoments moments;
+    regionMoments(image, x, y, width, height, moments);
+    return {meanColor(moments), calculateError(image, x, y, width, height), moments.count};
+}
+
+// statistics based error (only meaningful when supportsStatsMerging)
+double ErrorCalculator::calculateErrorFromStats(const BlockStats&) const {
+    return 0.0;
 }
 
 // variance sum up
-double VarianceErrorCalculator::calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    return (calculateVarianceForChannel(pixels, x, y, width, height, 0) +
-            calculateVarianceForChannel(pixels, x, y, width, height, 1) +
-            calculateVarianceForChannel(pixels, x, y, width, height, 2)) / 3.0;
-}
-
-// variance per channel
-double VarianceErrorCalculator::calculateVarianceForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel) {
-    double sum = 0;
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i)
-            sum += getChannelValue(pixels[j][i], channel);
-
-    double mean = sum / (width * height);
-    double variance = 0;
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i) {
-            double diff = getChannelValue(pixels[j][i], channel) - mean;
-            variance += diff * diff;
-        }
+double VarianceErrorCalculator::calculateError(const ImageView& image, int x, int y, int width, int height) {
+    return calculateRegionStats(image, x, y, width, height).error;
+}
+
+// mean and variance from the same moments (O(1) through the summed-area tables)
+RegionStats VarianceErrorCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    BlockStats stats;
+    regionMoments(image, x, y, width, height, stats.moments);
+    return {meanColor(stats.moments), calculateErrorFromStats(stats), stats.moments.count};
+}
 
-    return variance / (width * height);
+// variance from merged statistics
+double VarianceErrorCalculator::calculateErrorFromStats(const BlockStats& stats) const {
+    const ChannelMoments& m = stats.moments;
+    return (ErrorKernels::variance(m.count, m.sum[0], m.sumSq[0]) +
+            ErrorKernels::variance(m.count, m.sum[1], m.sumSq[1]) +
+            ErrorKernels::variance(m.count, m.sum[2], m.sumSq[2])) / 3.0;
 }
 
 // MAD sum up
-double MADErrorCalculator::calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    return (calculateMADForChannel(pixels, x, y, width, height, 0) +
-            calculateMADForChannel(pixels, x, y, width, height, 1) +
-            calculateMADForChannel(pixels, x, y, width, height, 2)) / 3.0;
+double MADErrorCalculator::calculateError(const ImageView& image, int x, int y, int width, int height) {
+    return calculateRegionStats(image, x, y, width, height).error;
 }
 
-// MAD per channel
-double MADErrorCalculator::calculateMADForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel) {
-    double sum = 0;
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i)
-            sum += getChannelValue(pixels[j][i], channel);
+RegionStats MADErrorCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    // first sweep for the means, second for the values above floor(mean)
+    ChannelMoments moments;
+    regionMoments(image, x, y, width, height, moments);
+    
+    int thresholds[3];
+    for (int c = 0; c < 3; ++c) {
+        thresholds[c] = static_cast<int>(moments.sum[c] / moments.count);
+    }
+    
+    ChannelTail tail;
+    ErrorKernels::blockTail(image, x, y, width, height, thresholds, tail);
+    
+    double error = (ErrorKernels::meanAbsoluteDeviation(moments.count, moments.sum[0], tail.count[0], tail.sum[0]) +
+                    ErrorKernels::meanAbsoluteDeviation(moments.count, moments.sum[1], tail.count[1], tail.sum[1]) +
+                    ErrorKernels::meanAbsoluteDeviation(moments.count, moments.sum[2], tail.count[2], tail.sum[2])) / 3.0;
+    return {meanColor(moments), error, moments.count};
+}
 
-    double mean = sum / (width * height);
-    double mad = 0;
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i)
-            mad += abs(getChannelValue(pixels[j][i], channel) - mean);
+// Diff sum up
+double MaxPixelDifferenceCalculator::calculateError(const ImageView& image, int x, int y, int width, int height) {
+    // O(1) for blocks on the pyramid levels, deeper (small) blocks are scanned
+    ChannelRange range;
+    if (!minMaxPyramid || !minMaxPyramid->query(x, y, width, height, range)) {
+        ErrorKernels::blockRange(image, x, y, width, height, range);
+    }
+    
+    return (static_cast<double>(range.maxValue[0] - range.minValue[0]) +
+            static_cast<double>(range.maxValue[1] - range.minValue[1]) +
+            static_cast<double>(range.maxValue[2] - range.minValue[2])) / 3.0;
+}
 
-    return mad / (width * height);
+// range from the pyramid plus a moments sweep, or both from one fused sweep
+RegionStats MaxPixelDifferenceCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    BlockStats stats;
+    if (minMaxPyramid && minMaxPyramid->query(x, y, width, height, stats.range)) {
+        regionMoments(image, x, y, width, height, stats.moments);
+    } else {
+        ErrorKernels::blockStats(image, x, y, width, height, stats);
+    }
+    return {meanColor(stats.moments), calculateErrorFromStats(stats), stats.moments.count};
 }
 
-// Diff sum up
-double MaxPixelDifferenceCalculator::calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    return (calculateMaxDiffForChannel(pixels, x, y, width, height, 0) +
-            calculateMaxDiffForChannel(pixels, x, y, width, height, 1) +
-            calculateMaxDiffForChannel(pixels, x, y, width, height, 2)) / 3.0;
-}
-
-// Diff per channel
-double MaxPixelDifferenceCalculator::calculateMaxDiffForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel) {
-    unsigned char minVal = 255, maxVal = 0;
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i) {
-            auto val = getChannelValue(pixels[j][i], channel);
-            minVal = min(minVal, val);
-            maxVal = max(maxVal, val);
-        }
-    return static_cast<double>(maxVal - minVal);
+// Diff from merged statistics
+double MaxPixelDifferenceCalculator::calculateErrorFromStats(const BlockStats& stats) const {
+    const ChannelRange& range = stats.range;
+    return (static_cast<double>(range.maxValue[0] - range.minValue[0]) +
+            static_cast<double>(range.maxValue[1] - range.minValue[1]) +
+            static_cast<double>(range.maxValue[2] - range.minValue[2])) / 3.0;
 }
 
 // Entropy sum up
-double EntropyCalculator::calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    return (calculateEntropyForChannel(pixels, x, y, width, height, 0) +
-            calculateEntropyForChannel(pixels, x, y, width, height, 1) +
-            calculateEntropyForChannel(pixels, x, y, width, height, 2)) / 3.0;
+double EntropyCalculator::calculateError(const ImageView& image, int x, int y, int width, int height) {
+    return calculateRegionStats(image, x, y, width, height).error;
+}
+
+RegionStats EntropyCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    // coarse blocks reuse the cached histograms, only small blocks are counted here
+    ChannelMoments moments;
+    moments.count = static_cast<uint64_t>(width) * height;
+    
+    double channel[3];
+    const ChannelHistogram* histogram = histogramPyramid ? histogramPyramid->query(x, y, width, height) : nullptr;
+    if (histogram) {
+        for (int c = 0; c < 3; ++c) {
+            channel[c] = ErrorKernels::entropy(histogram->bins[c], moments.count);
+            moments.sum[c] = 0;
+            for (int v = 1; v < 256; ++v) {
+                moments.sum[c] += static_cast<uint64_t>(v) * histogram->bins[c][v];
+            }
+        }
+    } else {
+        ErrorKernels::blockEntropy(image, x, y, width, height, channel, moments.sum);
+    }
+    
+    return {meanColor(moments), (channel[0] + channel[1] + channel[2]) / 3.0, moments.count};
 }
 
-// Entropy per channel
-double EntropyCalculator::calculateEntropyForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel) {
-    array<int,256> histogram{};
-    for (int j = y; j < y + height; ++j)
-        for (int i = x; i < x + width; ++i)
-            histogram[getChannelValue(pixels[j][i], channel)]++;
+// SSIM sum up
+double SSIMCalculator::calculateError(const ImageView& image, int x, int y, int width, int height) {
+    return calculateRegionStats(image, x, y, width, height).error;
+}
 
-    double entropy = 0, total = width * height;
-    for (auto count : histogram)
-        if (count)
-            entropy -= (count/total) * log2(count/total);
+// the compressed block is the flat mean color, so mean and variance are all SSIM needs
+RegionStats SSIMCalculator::calculateRegionStats(const ImageView& image, int x, int y, int width, int height) {
+    ChannelMoments moments;
+    regionMoments(image, x, y, width, height, moments);
+    return {meanColor(moments), calculateErrorFromMoments(moments), moments.count};
+}
 
-    return entropy;
+// SSIM from merged statistics
+double SSIMCalculator::calculateErrorFromStats(const BlockStats& stats) const {
+    return calculateErrorFromMoments(stats.moments);
 }
 
-// SSIM sum up
-double SSIMCalculator::calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    // Ciptakan blok gambar terkompresi (dengan warna rata-rata)
-    Pixel avgColor = calculateAverageColor(pixels, x, y, width, height);
-    vector<vector<Pixel>> compressedBlock(height, vector<Pixel>(width, avgColor));
-    
-    // Hitung SSIM untuk setiap kanal warna
-    double ssim_r = calculateSSIMForChannel(pixels, compressedBlock, x, y, width, height, 0);
-    double ssim_g = calculateSSIMForChannel(pixels, compressedBlock, x, y, width, height, 1);
-    double ssim_b = calculateSSIMForChannel(pixels, compressedBlock, x, y, width, height, 2);
-    
-    // Rata-rata SSIM untuk semua kanal (bobot seragam)
-    double avg_ssim = (ssim_r + ssim_g + ssim_b) / 3.0;
-    
-    // Definisi "error" = 1 - SSIM, makin besar SSIM makin kecil error
+// Rata-rata SSIM untuk semua kanal (bobot seragam), error = 1 - SSIM
+double SSIMCalculator::calculateErrorFromMoments(const ChannelMoments& m) {
+    double avg_ssim = (calculateSSIMFromMoments(m.count, m.sum[0], m.sumSq[0]) +
+                       calculateSSIMFromMoments(m.count, m.sum[1], m.sumSq[1]) +
+                       calculateSSIMFromMoments(m.count, m.sum[2], m.sumSq[2])) / 3.0;
     return 1.0 - avg_ssim;
 }
 
-// SSIM per channel
-double SSIMCalculator::calculateSSIMForChannel(const vector<vector<Pixel>>& originalBlock, const vector<vector<Pixel>>& compressedBlock, int x, int y, int width, int height, int channel){
+// SSIM per channel, closed form
+double SSIMCalculator::calculateSSIMFromMoments(uint64_t count, uint64_t sum, uint64_t sumSq) {
     const double L = 255.0;
     const double K1 = 0.01;
     const double K2 = 0.03;
     const double C1 = (K1 * L) * (K1 * L);
     const double C2 = (K2 * L) * (K2 * L);
     
-    int N = width * height;
-    if (N < 1) {
+    if (count < 1) {
         return 1.0;
     }
     
-    // mean for original and compressed blocks
-    double sum_x = 0.0, sum_y = 0.0;
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            sum_x += getChannelValue(originalBlock[y+j][x+i], channel);
-            sum_y += getChannelValue(compressedBlock[j][i], channel);
-        }
-    }
+    // the compressed block is flat: mu_y is the truncated mean, var_y = covar_xy = 0
+    double mu_x = static_cast<double>(sum) / count;
+    double mu_y = static_cast<double>(sum / count);
+    double var_x = count > 1 ? ErrorKernels::variance(count, sum, sumSq) * count / (count - 1) : 0.0;
     
-    double mu_x = sum_x / N;
-    double mu_y = sum_y / N;
-    
-    // variance and covar
-    double var_x = 0.0, var_y = 0.0, covar_xy = 0.0;
-    
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            double x_val = getChannelValue(originalBlock[y+j][x+i], channel);
-            double y_val = getChannelValue(compressedBlock[j][i], channel);
-            
-            double diff_x = x_val - mu_x;
-            double diff_y = y_val - mu_y;
-            
-            var_x += diff_x * diff_x;
-            var_y += diff_y * diff_y;
-            covar_xy += diff_x * diff_y;
-        }
-    }
-    
-    if (N > 1) {
-        var_x /= (N - 1);
-        var_y /= (N - 1);
-        covar_xy /= (N - 1);
-    } else {
-        var_x = var_y = covar_xy = 0.0;
-    }
-    
-    //    SSIM(x,y) = ((2μxμy + C1)(2σxy + C2)) / ((μx² + μy² + C1)(σx² + σy² + C2))
-    double numerator = (2.0 * mu_x * mu_y + C1) * (2.0 * covar_xy + C2);
-    double denominator = (mu_x * mu_x + mu_y * mu_y + C1) * (var_x + var_y + C2);
+    double numerator = (2.0 * mu_x * mu_y + C1) * C2;
+    double denominator = (mu_x * mu_x + mu_y * mu_y + C1) * (var_x + C2);
     
     if (denominator < 1e-10) {
         return 1.0;
     }
     
-    double ssim = numerator / denominator;
-    
-    return ssim;
-}
-
-// compressed block
-Pixel SSIMCalculator::calculateAverageColor(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) {
-    int totalR = 0, totalG = 0, totalB = 0;
-    int count = width * height;
-    
-    for (int j = y; j < y + height; ++j) {
-        for (int i = x; i < x + width; ++i) {
-            totalR += pixels[j][i].r;
-            totalG += pixels[j][i].g;
-            totalB += pixels[j][i].b;
-        }
-    }
-    
-    return Pixel(
-        static_cast<unsigned char>(totalR / count),
-        static_cast<unsigned char>(totalG / count),
-        static_cast<unsigned char>(totalB / count)
-    );
+    return numerator / denominator;
 }
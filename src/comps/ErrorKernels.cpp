@@ -0,0 +1,769 @@
+// include header file
+#include "ErrorKernels.hpp"
+
+// include lib files
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+
+// x86 SIMD paths, compiled per function so no global -mavx2 is required
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define QUADTREE_X86 1
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+#endif
+
+#if defined(QUADTREE_X86) && (defined(__GNUC__) || defined(__clang__))
+    #define QUADTREE_TARGET_SSE2 __attribute__((target("sse2")))
+    #define QUADTREE_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+    #define QUADTREE_TARGET_SSE2
+    #define QUADTREE_TARGET_AVX2
+#endif
+
+
+// 16-bit lane accumulators are flushed before they can overflow (128 * 255 < 65536)
+static const size_t FLUSH_INTERVAL = 128;
+
+// byte k of a row span belongs to channel k % 3, so every 48 bytes the lane layout repeats
+static const size_t SPAN_PERIOD = 48;
+
+static atomic<int> activeSet(-1);
+
+// n * log2(n), tabulated for the counts small blocks produce
+static const uint64_t N_LOG_N_TABLE_SIZE = 1 << 16;
+
+static double nLogN(uint64_t n) {
+    static const vector<double> table = [] {
+        vector<double> values(N_LOG_N_TABLE_SIZE);
+        values[0] = 0.0;
+        for (uint64_t i = 1; i < N_LOG_N_TABLE_SIZE; ++i) {
+            values[i] = i * log2(static_cast<double>(i));
+        }
+        return values;
+    }();
+    
+    if (n < N_LOG_N_TABLE_SIZE) {
+        return table[n];
+    }
+    return n * log2(static_cast<double>(n));
+}
+
+
+// ===== Scalar kernels =====
+
+// range is only gathered when requested (bottom-up block statistics)
+template <bool WithRange>
+static void momentsScalar(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out, ChannelRange* range) {
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        uint64_t sum[3] = {0, 0, 0};
+        uint64_t sumSq[3] = {0, 0, 0};
+        for (int i = x; i < x + width; ++i) {
+            const unsigned r = row[i].r, g = row[i].g, b = row[i].b;
+            sum[0] += r; sumSq[0] += r * r;
+            sum[1] += g; sumSq[1] += g * g;
+            sum[2] += b; sumSq[2] += b * b;
+            if (WithRange) {
+                range->minValue[0] = min(range->minValue[0], row[i].r);
+                range->maxValue[0] = max(range->maxValue[0], row[i].r);
+                range->minValue[1] = min(range->minValue[1], row[i].g);
+                range->maxValue[1] = max(range->maxValue[1], row[i].g);
+                range->minValue[2] = min(range->minValue[2], row[i].b);
+                range->maxValue[2] = max(range->maxValue[2], row[i].b);
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            out.sum[c] += sum[c];
+            out.sumSq[c] += sumSq[c];
+        }
+    }
+}
+
+static void rangeScalar(const ImageView& image, int x, int y, int width, int height, ChannelRange& out) {
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        for (int i = x; i < x + width; ++i) {
+            out.minValue[0] = min(out.minValue[0], row[i].r);
+            out.maxValue[0] = max(out.maxValue[0], row[i].r);
+            out.minValue[1] = min(out.minValue[1], row[i].g);
+            out.maxValue[1] = max(out.maxValue[1], row[i].g);
+            out.minValue[2] = min(out.minValue[2], row[i].b);
+            out.maxValue[2] = max(out.maxValue[2], row[i].b);
+        }
+    }
+}
+
+static void tailScalar(const ImageView& image, int x, int y, int width, int height, const int thresholds[3], ChannelTail& out) {
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        for (int i = x; i < x + width; ++i) {
+            const int values[3] = {row[i].r, row[i].g, row[i].b};
+            for (int c = 0; c < 3; ++c) {
+                if (values[c] > thresholds[c]) {
+                    out.count[c]++;
+                    out.sum[c] += values[c];
+                }
+            }
+        }
+    }
+}
+
+// leftover bytes of a span (fewer than one SIMD period), offset keeps the channel phase
+static void momentsSpanTail(const unsigned char* span, size_t begin, size_t end, ChannelMoments& out) {
+    for (size_t k = begin; k < end; ++k) {
+        const unsigned v = span[k];
+        out.sum[k % 3] += v;
+        out.sumSq[k % 3] += v * v;
+    }
+}
+
+static void rangeSpanTail(const unsigned char* span, size_t begin, size_t end, ChannelRange& out) {
+    for (size_t k = begin; k < end; ++k) {
+        out.minValue[k % 3] = min(out.minValue[k % 3], span[k]);
+        out.maxValue[k % 3] = max(out.maxValue[k % 3], span[k]);
+    }
+}
+
+// folds 16-byte min/max accumulators (lane l of vector v is byte 16v + l of the period)
+static void rangeLanes(const unsigned char minLanes[3][16], const unsigned char maxLanes[3][16], ChannelRange& out) {
+    for (int v = 0; v < 3; ++v) {
+        for (int l = 0; l < 16; ++l) {
+            int c = (16 * v + l) % 3;
+            out.minValue[c] = min(out.minValue[c], minLanes[v][l]);
+            out.maxValue[c] = max(out.maxValue[c], maxLanes[v][l]);
+        }
+    }
+}
+
+static void tailSpanTail(const unsigned char* span, size_t begin, size_t end, const int thresholds[3], ChannelTail& out) {
+    for (size_t k = begin; k < end; ++k) {
+        if (span[k] > thresholds[k % 3]) {
+            out.count[k % 3]++;
+            out.sum[k % 3] += span[k];
+        }
+    }
+}
+
+static void swapRedBlueScalar(unsigned char* bytes, size_t begin, size_t end) {
+    for (size_t k = begin; k + 3 <= end; k += 3) {
+        unsigned char first = bytes[k];
+        bytes[k] = bytes[k + 2];
+        bytes[k + 2] = first;
+    }
+}
+
+
+#ifdef QUADTREE_X86
+
+// ===== SSE2 kernels (16 bytes per vector, three vectors per period) =====
+
+template <bool WithRange>
+QUADTREE_TARGET_SSE2
+static void momentsSSE2(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out, ChannelRange* range) {
+    const __m128i zero = _mm_setzero_si128();
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+    __m128i minimum[3], maximum[3];
+    for (int v = 0; v < 3; ++v) {
+        minimum[v] = _mm_set1_epi8(static_cast<char>(0xFF));
+        maximum[v] = zero;
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+
+        while (spanBytes - k >= SPAN_PERIOD) {
+            __m128i sums[3][2], squares[3][4];
+            for (int v = 0; v < 3; ++v) {
+                sums[v][0] = sums[v][1] = zero;
+                squares[v][0] = squares[v][1] = squares[v][2] = squares[v][3] = zero;
+            }
+
+            size_t iterations = min((spanBytes - k) / SPAN_PERIOD, FLUSH_INTERVAL);
+            for (size_t it = 0; it < iterations; ++it, k += SPAN_PERIOD) {
+                for (int v = 0; v < 3; ++v) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(span + k + 16 * v));
+                    if (WithRange) {
+                        minimum[v] = _mm_min_epu8(minimum[v], bytes);
+                        maximum[v] = _mm_max_epu8(maximum[v], bytes);
+                    }
+                    __m128i low = _mm_unpacklo_epi8(bytes, zero);
+                    __m128i high = _mm_unpackhi_epi8(bytes, zero);
+                    sums[v][0] = _mm_add_epi16(sums[v][0], low);
+                    sums[v][1] = _mm_add_epi16(sums[v][1], high);
+
+                    // 255^2 still fits an unsigned 16-bit lane
+                    __m128i lowSq = _mm_mullo_epi16(low, low);
+                    __m128i highSq = _mm_mullo_epi16(high, high);
+                    squares[v][0] = _mm_add_epi32(squares[v][0], _mm_unpacklo_epi16(lowSq, zero));
+                    squares[v][1] = _mm_add_epi32(squares[v][1], _mm_unpackhi_epi16(lowSq, zero));
+                    squares[v][2] = _mm_add_epi32(squares[v][2], _mm_unpacklo_epi16(highSq, zero));
+                    squares[v][3] = _mm_add_epi32(squares[v][3], _mm_unpackhi_epi16(highSq, zero));
+                }
+            }
+
+            // lane l of vector v holds byte 16v + l of the period
+            alignas(16) uint16_t sumLanes[8];
+            alignas(16) uint32_t squareLanes[4];
+            for (int v = 0; v < 3; ++v) {
+                for (int half = 0; half < 2; ++half) {
+                    _mm_store_si128(reinterpret_cast<__m128i*>(sumLanes), sums[v][half]);
+                    for (int l = 0; l < 8; ++l) {
+                        out.sum[(16 * v + 8 * half + l) % 3] += sumLanes[l];
+                    }
+                }
+                for (int quarter = 0; quarter < 4; ++quarter) {
+                    _mm_store_si128(reinterpret_cast<__m128i*>(squareLanes), squares[v][quarter]);
+                    for (int l = 0; l < 4; ++l) {
+                        out.sumSq[(16 * v + 4 * quarter + l) % 3] += squareLanes[l];
+                    }
+                }
+            }
+        }
+
+        momentsSpanTail(span, k, spanBytes, out);
+        if (WithRange) {
+            rangeSpanTail(span, k, spanBytes, *range);
+        }
+    }
+
+    if (WithRange) {
+        alignas(16) unsigned char minLanes[3][16], maxLanes[3][16];
+        for (int v = 0; v < 3; ++v) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(minLanes[v]), minimum[v]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(maxLanes[v]), maximum[v]);
+        }
+        rangeLanes(minLanes, maxLanes, *range);
+    }
+}
+
+QUADTREE_TARGET_SSE2
+static void rangeSSE2(const ImageView& image, int x, int y, int width, int height, ChannelRange& out) {
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+    __m128i minimum[3], maximum[3];
+    for (int v = 0; v < 3; ++v) {
+        minimum[v] = _mm_set1_epi8(static_cast<char>(0xFF));
+        maximum[v] = _mm_setzero_si128();
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+        for (; spanBytes - k >= SPAN_PERIOD; k += SPAN_PERIOD) {
+            for (int v = 0; v < 3; ++v) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(span + k + 16 * v));
+                minimum[v] = _mm_min_epu8(minimum[v], bytes);
+                maximum[v] = _mm_max_epu8(maximum[v], bytes);
+            }
+        }
+        rangeSpanTail(span, k, spanBytes, out);
+    }
+
+    alignas(16) unsigned char minLanes[3][16], maxLanes[3][16];
+    for (int v = 0; v < 3; ++v) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(minLanes[v]), minimum[v]);
+        _mm_store_si128(reinterpret_cast<__m128i*>(maxLanes[v]), maximum[v]);
+    }
+    rangeLanes(minLanes, maxLanes, out);
+}
+
+QUADTREE_TARGET_SSE2
+static void tailSSE2(const ImageView& image, int x, int y, int width, int height, const int thresholds[3], ChannelTail& out) {
+    const __m128i zero = _mm_setzero_si128();
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+
+    // per-lane thresholds following the channel phase of each 8-lane half
+    __m128i limits[3][2];
+    for (int v = 0; v < 3; ++v) {
+        for (int half = 0; half < 2; ++half) {
+            alignas(16) int16_t lanes[8];
+            for (int l = 0; l < 8; ++l) {
+                lanes[l] = static_cast<int16_t>(thresholds[(16 * v + 8 * half + l) % 3]);
+            }
+            limits[v][half] = _mm_load_si128(reinterpret_cast<const __m128i*>(lanes));
+        }
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+
+        while (spanBytes - k >= SPAN_PERIOD) {
+            __m128i sums[3][2], counts[3][2];
+            for (int v = 0; v < 3; ++v) {
+                sums[v][0] = sums[v][1] = counts[v][0] = counts[v][1] = zero;
+            }
+
+            size_t iterations = min((spanBytes - k) / SPAN_PERIOD, FLUSH_INTERVAL);
+            for (size_t it = 0; it < iterations; ++it, k += SPAN_PERIOD) {
+                for (int v = 0; v < 3; ++v) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(span + k + 16 * v));
+                    __m128i words[2] = {_mm_unpacklo_epi8(bytes, zero), _mm_unpackhi_epi8(bytes, zero)};
+                    for (int half = 0; half < 2; ++half) {
+                        __m128i above = _mm_cmpgt_epi16(words[half], limits[v][half]);
+                        sums[v][half] = _mm_add_epi16(sums[v][half], _mm_and_si128(above, words[half]));
+                        counts[v][half] = _mm_sub_epi16(counts[v][half], above);
+                    }
+                }
+            }
+
+            alignas(16) uint16_t sumLanes[8], countLanes[8];
+            for (int v = 0; v < 3; ++v) {
+                for (int half = 0; half < 2; ++half) {
+                    _mm_store_si128(reinterpret_cast<__m128i*>(sumLanes), sums[v][half]);
+                    _mm_store_si128(reinterpret_cast<__m128i*>(countLanes), counts[v][half]);
+                    for (int l = 0; l < 8; ++l) {
+                        int c = (16 * v + 8 * half + l) % 3;
+                        out.sum[c] += sumLanes[l];
+                        out.count[c] += countLanes[l];
+                    }
+                }
+            }
+        }
+
+        tailSpanTail(span, k, spanBytes, thresholds, out);
+    }
+}
+
+
+// ===== AVX2 kernels (16 bytes widened to 16 words per vector) =====
+
+template <bool WithRange>
+QUADTREE_TARGET_AVX2
+static void momentsAVX2(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out, ChannelRange* range) {
+    const __m256i zero = _mm256_setzero_si256();
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+    __m128i minimum[3], maximum[3];
+    for (int v = 0; v < 3; ++v) {
+        minimum[v] = _mm_set1_epi8(static_cast<char>(0xFF));
+        maximum[v] = _mm_setzero_si128();
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+
+        while (spanBytes - k >= SPAN_PERIOD) {
+            __m256i sums[3], squares[3][2];
+            for (int v = 0; v < 3; ++v) {
+                sums[v] = squares[v][0] = squares[v][1] = zero;
+            }
+
+            size_t iterations = min((spanBytes - k) / SPAN_PERIOD, FLUSH_INTERVAL);
+            for (size_t it = 0; it < iterations; ++it, k += SPAN_PERIOD) {
+                for (int v = 0; v < 3; ++v) {
+                    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(span + k + 16 * v));
+                    if (WithRange) {
+                        minimum[v] = _mm_min_epu8(minimum[v], bytes);
+                        maximum[v] = _mm_max_epu8(maximum[v], bytes);
+                    }
+                    __m256i words = _mm256_cvtepu8_epi16(bytes);
+                    sums[v] = _mm256_add_epi16(sums[v], words);
+
+                    __m256i wordsSq = _mm256_mullo_epi16(words, words);
+                    squares[v][0] = _mm256_add_epi32(squares[v][0], _mm256_cvtepu16_epi32(_mm256_castsi256_si128(wordsSq)));
+                    squares[v][1] = _mm256_add_epi32(squares[v][1], _mm256_cvtepu16_epi32(_mm256_extracti128_si256(wordsSq, 1)));
+                }
+            }
+
+            alignas(32) uint16_t sumLanes[16];
+            alignas(32) uint32_t squareLanes[8];
+            for (int v = 0; v < 3; ++v) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(sumLanes), sums[v]);
+                for (int l = 0; l < 16; ++l) {
+                    out.sum[(16 * v + l) % 3] += sumLanes[l];
+                }
+                for (int half = 0; half < 2; ++half) {
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(squareLanes), squares[v][half]);
+                    for (int l = 0; l < 8; ++l) {
+                        out.sumSq[(16 * v + 8 * half + l) % 3] += squareLanes[l];
+                    }
+                }
+            }
+        }
+
+        momentsSpanTail(span, k, spanBytes, out);
+        if (WithRange) {
+            rangeSpanTail(span, k, spanBytes, *range);
+        }
+    }
+
+    if (WithRange) {
+        alignas(16) unsigned char minLanes[3][16], maxLanes[3][16];
+        for (int v = 0; v < 3; ++v) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(minLanes[v]), minimum[v]);
+            _mm_store_si128(reinterpret_cast<__m128i*>(maxLanes[v]), maximum[v]);
+        }
+        rangeLanes(minLanes, maxLanes, *range);
+    }
+}
+
+QUADTREE_TARGET_AVX2
+static void rangeAVX2(const ImageView& image, int x, int y, int width, int height, ChannelRange& out) {
+    // 32-byte vectors repeat their channel phase every 96 bytes
+    const size_t period = 2 * SPAN_PERIOD;
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+    __m256i minimum[3], maximum[3];
+    for (int v = 0; v < 3; ++v) {
+        minimum[v] = _mm256_set1_epi8(static_cast<char>(0xFF));
+        maximum[v] = _mm256_setzero_si256();
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+        for (; spanBytes - k >= period; k += period) {
+            for (int v = 0; v < 3; ++v) {
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(span + k + 32 * v));
+                minimum[v] = _mm256_min_epu8(minimum[v], bytes);
+                maximum[v] = _mm256_max_epu8(maximum[v], bytes);
+            }
+        }
+        rangeSpanTail(span, k, spanBytes, out);
+    }
+
+    alignas(32) unsigned char minLanes[32], maxLanes[32];
+    for (int v = 0; v < 3; ++v) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(minLanes), minimum[v]);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(maxLanes), maximum[v]);
+        for (int l = 0; l < 32; ++l) {
+            int c = (32 * v + l) % 3;
+            out.minValue[c] = min(out.minValue[c], minLanes[l]);
+            out.maxValue[c] = max(out.maxValue[c], maxLanes[l]);
+        }
+    }
+}
+
+QUADTREE_TARGET_AVX2
+static void tailAVX2(const ImageView& image, int x, int y, int width, int height, const int thresholds[3], ChannelTail& out) {
+    const __m256i zero = _mm256_setzero_si256();
+    const size_t spanBytes = static_cast<size_t>(width) * 3;
+
+    __m256i limits[3];
+    for (int v = 0; v < 3; ++v) {
+        alignas(32) int16_t lanes[16];
+        for (int l = 0; l < 16; ++l) {
+            lanes[l] = static_cast<int16_t>(thresholds[(16 * v + l) % 3]);
+        }
+        limits[v] = _mm256_load_si256(reinterpret_cast<const __m256i*>(lanes));
+    }
+
+    for (int j = y; j < y + height; ++j) {
+        const unsigned char* span = image.rowBytes(j) + static_cast<size_t>(x) * 3;
+        size_t k = 0;
+
+        while (spanBytes - k >= SPAN_PERIOD) {
+            __m256i sums[3], counts[3];
+            for (int v = 0; v < 3; ++v) {
+                sums[v] = counts[v] = zero;
+            }
+
+            size_t iterations = min((spanBytes - k) / SPAN_PERIOD, FLUSH_INTERVAL);
+            for (size_t it = 0; it < iterations; ++it, k += SPAN_PERIOD) {
+                for (int v = 0; v < 3; ++v) {
+                    __m256i words = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(span + k + 16 * v)));
+                    __m256i above = _mm256_cmpgt_epi16(words, limits[v]);
+                    sums[v] = _mm256_add_epi16(sums[v], _mm256_and_si256(above, words));
+                    counts[v] = _mm256_sub_epi16(counts[v], above);
+                }
+            }
+
+            alignas(32) uint16_t sumLanes[16], countLanes[16];
+            for (int v = 0; v < 3; ++v) {
+                _mm256_store_si256(reinterpret_cast<__m256i*>(sumLanes), sums[v]);
+                _mm256_store_si256(reinterpret_cast<__m256i*>(countLanes), counts[v]);
+                for (int l = 0; l < 16; ++l) {
+                    int c = (16 * v + l) % 3;
+                    out.sum[c] += sumLanes[l];
+                    out.count[c] += countLanes[l];
+                }
+            }
+        }
+
+        tailSpanTail(span, k, spanBytes, thresholds, out);
+    }
+}
+
+// five whole pixels per 16-byte shuffle (byte 15 passes through); four loads go out before
+// the overlapping stores so no load waits on the store just before it
+QUADTREE_TARGET_AVX2
+static void swapRedBlueAVX2(unsigned char* bytes, size_t size) {
+    const __m128i order = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+    size_t k = 0;
+    for (; k + 61 <= size; k += 60) {
+        __m128i v[4];
+        for (int i = 0; i < 4; ++i) {
+            v[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + k + 15 * i));
+        }
+        for (int i = 0; i < 4; ++i) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes + k + 15 * i), _mm_shuffle_epi8(v[i], order));
+        }
+    }
+    swapRedBlueScalar(bytes, k, size);
+}
+
+#endif
+
+
+// ===== Dispatch =====
+
+bool ErrorKernels::isSupported(InstructionSet set) {
+    switch (set) {
+        case InstructionSet::SCALAR:
+            return true;
+#ifdef QUADTREE_X86
+    #if defined(_MSC_VER)
+        case InstructionSet::SSE2: {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[3] & (1 << 26)) != 0;
+        }
+        case InstructionSet::AVX2: {
+            int info[4];
+            __cpuid(info, 1);
+            bool osSavesYmm = (info[2] & (1 << 27)) && (_xgetbv(0) & 0x6) == 0x6;
+            __cpuidex(info, 7, 0);
+            return osSavesYmm && (info[1] & (1 << 5)) != 0;
+        }
+    #else
+        case InstructionSet::SSE2:
+            return __builtin_cpu_supports("sse2");
+        case InstructionSet::AVX2:
+            return __builtin_cpu_supports("avx2");
+    #endif
+#endif
+        default:
+            return false;
+    }
+}
+
+ErrorKernels::InstructionSet ErrorKernels::detectInstructionSet() {
+    // manual override, mainly for comparing the variants
+    const char* requested = getenv("QUADTREE_SIMD");
+    if (requested) {
+        string name(requested);
+        if (name == "scalar") return InstructionSet::SCALAR;
+        if (name == "sse2" && isSupported(InstructionSet::SSE2)) return InstructionSet::SSE2;
+        if (name == "avx2" && isSupported(InstructionSet::AVX2)) return InstructionSet::AVX2;
+    }
+
+    if (isSupported(InstructionSet::AVX2)) return InstructionSet::AVX2;
+    if (isSupported(InstructionSet::SSE2)) return InstructionSet::SSE2;
+    return InstructionSet::SCALAR;
+}
+
+// rows narrower than one period never enter the vector loops, skip their setup
+static ErrorKernels::InstructionSet instructionSetFor(int width) {
+    if (static_cast<size_t>(width) * 3 < SPAN_PERIOD) {
+        return ErrorKernels::InstructionSet::SCALAR;
+    }
+    return ErrorKernels::getInstructionSet();
+}
+
+ErrorKernels::InstructionSet ErrorKernels::getInstructionSet() {
+    int set = activeSet.load(memory_order_relaxed);
+    if (set < 0) {
+        set = static_cast<int>(detectInstructionSet());
+        activeSet.store(set, memory_order_relaxed);
+    }
+    return static_cast<InstructionSet>(set);
+}
+
+void ErrorKernels::setInstructionSet(InstructionSet set) {
+    if (!isSupported(set)) {
+        set = InstructionSet::SCALAR;
+    }
+    activeSet.store(static_cast<int>(set), memory_order_relaxed);
+}
+
+string ErrorKernels::getInstructionSetName() {
+    switch (getInstructionSet()) {
+        case InstructionSet::AVX2: return "AVX2";
+        case InstructionSet::SSE2: return "SSE2";
+        default: return "scalar";
+    }
+}
+
+
+// ===== Kernel entry points =====
+
+void ErrorKernels::blockMoments(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out) {
+    out = ChannelMoments{};
+    out.count = static_cast<uint64_t>(width) * height;
+
+    switch (instructionSetFor(width)) {
+#ifdef QUADTREE_X86
+        case InstructionSet::AVX2: momentsAVX2<false>(image, x, y, width, height, out, nullptr); return;
+        case InstructionSet::SSE2: momentsSSE2<false>(image, x, y, width, height, out, nullptr); return;
+#endif
+        default: momentsScalar<false>(image, x, y, width, height, out, nullptr); return;
+    }
+}
+
+// moments and range of a block in one sweep
+void ErrorKernels::blockStats(const ImageView& image, int x, int y, int width, int height, BlockStats& out) {
+    out.moments = ChannelMoments{};
+    out.moments.count = static_cast<uint64_t>(width) * height;
+    for (int c = 0; c < 3; ++c) {
+        out.range.minValue[c] = 255;
+        out.range.maxValue[c] = 0;
+    }
+
+    switch (instructionSetFor(width)) {
+#ifdef QUADTREE_X86
+        case InstructionSet::AVX2: momentsAVX2<true>(image, x, y, width, height, out.moments, &out.range); return;
+        case InstructionSet::SSE2: momentsSSE2<true>(image, x, y, width, height, out.moments, &out.range); return;
+#endif
+        default: momentsScalar<true>(image, x, y, width, height, out.moments, &out.range); return;
+    }
+}
+
+void ErrorKernels::blockRange(const ImageView& image, int x, int y, int width, int height, ChannelRange& out) {
+    for (int c = 0; c < 3; ++c) {
+        out.minValue[c] = 255;
+        out.maxValue[c] = 0;
+    }
+
+    switch (instructionSetFor(width)) {
+#ifdef QUADTREE_X86
+        case InstructionSet::AVX2: rangeAVX2(image, x, y, width, height, out); return;
+        case InstructionSet::SSE2: rangeSSE2(image, x, y, width, height, out); return;
+#endif
+        default: rangeScalar(image, x, y, width, height, out); return;
+    }
+}
+
+void ErrorKernels::blockTail(const ImageView& image, int x, int y, int width, int height, const int thresholds[3], ChannelTail& out) {
+    out = ChannelTail{};
+
+    switch (instructionSetFor(width)) {
+#ifdef QUADTREE_X86
+        case InstructionSet::AVX2: tailAVX2(image, x, y, width, height, thresholds, out); return;
+        case InstructionSet::SSE2: tailSSE2(image, x, y, width, height, thresholds, out); return;
+#endif
+        default: tailScalar(image, x, y, width, height, thresholds, out); return;
+    }
+}
+
+// histogramming is scatter-bound, one fused scalar sweep serves every instruction set
+void ErrorKernels::blockHistogram(const ImageView& image, int x, int y, int width, int height, ChannelHistogram& out) {
+    memset(out.bins, 0, sizeof(out.bins));
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        for (int i = x; i < x + width; ++i) {
+            out.bins[0][row[i].r]++;
+            out.bins[1][row[i].g]++;
+            out.bins[2][row[i].b]++;
+        }
+    }
+}
+
+// small blocks touch few bins (channel sums come along for the mean color): count into a zeroed scratch histogram, then visit each
+// distinct value once through the pixels and clear it again, so no 256-bin scan is needed
+void ErrorKernels::blockEntropy(const ImageView& image, int x, int y, int width, int height, double out[3], uint64_t sum[3]) {
+    static thread_local ChannelHistogram scratch = {};
+    
+    sum[0] = sum[1] = sum[2] = 0;
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        for (int i = x; i < x + width; ++i) {
+            scratch.bins[0][row[i].r]++;
+            scratch.bins[1][row[i].g]++;
+            scratch.bins[2][row[i].b]++;
+            sum[0] += row[i].r;
+            sum[1] += row[i].g;
+            sum[2] += row[i].b;
+        }
+    }
+    
+    double weighted[3] = {0, 0, 0};
+    for (int j = y; j < y + height; ++j) {
+        const Pixel* row = image.row(j);
+        for (int i = x; i < x + width; ++i) {
+            const unsigned char values[3] = {row[i].r, row[i].g, row[i].b};
+            for (int c = 0; c < 3; ++c) {
+                uint32_t& bin = scratch.bins[c][values[c]];
+                if (bin) {
+                    weighted[c] += nLogN(bin);
+                    bin = 0;
+                }
+            }
+        }
+    }
+    
+    uint64_t count = static_cast<uint64_t>(width) * height;
+    for (int c = 0; c < 3; ++c) {
+        out[c] = count ? max(0.0, log2(static_cast<double>(count)) - weighted[c] / count) : 0.0;
+    }
+}
+
+// pshufb needs SSSE3, so the SSE2 set keeps the scalar swap
+void ErrorKernels::swapRedBlue(unsigned char* bytes, int count) {
+    size_t size = static_cast<size_t>(count) * 3;
+    switch (getInstructionSet()) {
+#ifdef QUADTREE_X86
+        case InstructionSet::AVX2: swapRedBlueAVX2(bytes, size); return;
+#endif
+        default: swapRedBlueScalar(bytes, 0, size); return;
+    }
+}
+
+
+// ===== Metric formulas =====
+
+// population variance, (n * sum(x^2) - sum(x)^2) / n^2
+double ErrorKernels::variance(uint64_t count, uint64_t sum, uint64_t sumSq) {
+    if (count == 0) {
+        return 0.0;
+    }
+
+    // exact in 64-bit while count * sumSq <= count^2 * 255^2 fits (blocks below 2^24 pixels)
+    if (count < (1ull << 24)) {
+        uint64_t numerator = count * sumSq - sum * sum;
+        return static_cast<double>(numerator) / (static_cast<double>(count) * count);
+    }
+
+    double mean = static_cast<double>(sum) / count;
+    double result = static_cast<double>(sumSq) / count - mean * mean;
+
+    // rounding can push a flat block slightly below zero
+    return result > 0.0 ? result : 0.0;
+}
+
+// mean absolute deviation from the values above floor(mean):
+// sum|x - m| = 2 * sum_{x > m}(x - m), so MAD = 2 * (n * tailSum - sum * tailCount) / n^2
+double ErrorKernels::meanAbsoluteDeviation(uint64_t count, uint64_t sum, uint64_t tailCount, uint64_t tailSum) {
+    if (count == 0) {
+        return 0.0;
+    }
+
+    if (count < (1ull << 24)) {
+        uint64_t numerator = 2 * (count * tailSum - sum * tailCount);
+        return static_cast<double>(numerator) / (static_cast<double>(count) * count);
+    }
+
+    double mean = static_cast<double>(sum) / count;
+    return 2.0 * (static_cast<double>(tailSum) - mean * tailCount) / count;
+}
+
+// shannon entropy (bits) of one channel histogram
+// -sum (c/t) log2(c/t) = log2(t) - sum c log2(c) / t
+double ErrorKernels::entropy(const uint32_t bins[256], uint64_t count) {
+    if (count == 0) {
+        return 0.0;
+    }
+    
+    double weighted = 0;
+    for (int v = 0; v < 256; ++v) {
+        if (bins[v]) {
+            weighted += nLogN(bins[v]);
+        }
+    }
+    return max(0.0, log2(static_cast<double>(count)) - weighted / count);
+}
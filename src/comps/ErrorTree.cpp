@@ -0,0 +1,130 @@
+// include header file
+#include "ErrorTree.hpp"
+
+// include lib files
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+
+ErrorTree::ErrorTree() {
+    // cons
+}
+
+void ErrorTree::clear() {
+    full = QuadTree();
+    errors.clear();
+    errors.shrink_to_fit();
+    reaches.clear();
+    reaches.shrink_to_fit();
+    rowRunsAbove.clear();
+    rowRunsAbove.shrink_to_fit();
+    columnRunsAbove.clear();
+    columnRunsAbove.shrink_to_fit();
+}
+
+// largest block per level, capped by the area: every block below the root covers at
+// least minBlockSize pixels, so there are at most area / minBlockSize leaves
+size_t ErrorTree::estimateNodeCount(int width, int height, int minBlockSize) {
+    size_t bound = static_cast<size_t>(width) * height / max(1, minBlockSize) * 4 / 3 + 1;
+    size_t total = 1;
+    size_t levelNodes = 1;
+    while (static_cast<int64_t>(width / 2) * (height / 2) >= minBlockSize && levelNodes < (static_cast<size_t>(1) << 40)) {
+        levelNodes *= 4;
+        total += levelNodes;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    return min(total, bound);
+}
+
+void ErrorTree::build(ErrorCalculator& calculator, const ImageView& image, int minBlockSize) {
+    clear();
+    full.reset(image.getWidth(), image.getHeight());
+    full.reserve(estimateNodeCount(image.getWidth(), image.getHeight(), minBlockSize));
+    errors.reserve(full.getNodes().capacity());
+    errors.assign(1, 0.0);
+    
+    buildNode(calculator, image, minBlockSize, full.getRoot(), numeric_limits<double>::infinity());
+    
+    // splitting a block adds its height to the row runs (its children cover it twice)
+    // and its width to the column runs
+    sort(splits.begin(), splits.end(), [](const Split& a, const Split& b) { return a.reach < b.reach; });
+    reaches.resize(splits.size());
+    rowRunsAbove.assign(splits.size() + 1, 0);
+    columnRunsAbove.assign(splits.size() + 1, 0);
+    for (size_t i = splits.size(); i-- > 0;) {
+        reaches[i] = splits[i].reach;
+        rowRunsAbove[i] = rowRunsAbove[i + 1] + splits[i].height;
+        columnRunsAbove[i] = columnRunsAbove[i + 1] + splits[i].width;
+    }
+    splits.clear();
+    splits.shrink_to_fit();
+}
+
+void ErrorTree::buildNode(ErrorCalculator& calculator, const ImageView& image, int minBlockSize, const QuadTreeNode& node, double parentReach) {
+    const uint32_t index = node.getIndex();
+    RegionStats stats = calculator.calculateRegionStats(image, node.getX(), node.getY(), node.getWidth(), node.getHeight());
+    full.setColor(index, stats.meanColor);
+    errors[index] = stats.error;
+    
+    // partisi blok, same limit as the top-down build
+    int subBlockArea = (node.getWidth() / 2) * (node.getHeight() / 2);
+    if (subBlockArea < minBlockSize) {
+        return;
+    }
+    
+    // a NaN error never splits, and neither does anything below it
+    double reach = isnan(stats.error) ? -numeric_limits<double>::infinity() : min(parentReach, stats.error);
+    splits.push_back({reach, node.getWidth(), node.getHeight()});
+    
+    full.split(index);
+    errors.resize(full.size());
+    for (int i = 0; i < 4; ++i) {
+        buildNode(calculator, image, minBlockSize, full.getChild(node, i), reach);
+    }
+}
+
+// split blocks are exactly those with a reach above the threshold
+int ErrorTree::countLeaves(double threshold) const {
+    if (full.empty()) {
+        return 0;
+    }
+    size_t splitCount = reaches.end() - upper_bound(reaches.begin(), reaches.end(), threshold);
+    return static_cast<int>(1 + 3 * splitCount);
+}
+
+TreeFeatures ErrorTree::cutFeatures(double threshold) const {
+    TreeFeatures features = {0, 0};
+    if (full.empty()) {
+        return features;
+    }
+    size_t first = upper_bound(reaches.begin(), reaches.end(), threshold) - reaches.begin();
+    features.rowRuns = full.getHeight() + rowRunsAbove[first];
+    features.columnRuns = full.getWidth() + columnRunsAbove[first];
+    return features;
+}
+
+void ErrorTree::extract(double threshold, QuadTree& tree) const {
+    if (full.empty()) {
+        tree = QuadTree();
+        return;
+    }
+    tree.reset(full.getWidth(), full.getHeight());
+    tree.reserve(static_cast<size_t>(countLeaves(threshold)) * 4 / 3 + 1);
+    extractNode(threshold, full.getRoot(), tree, tree.getRoot());
+}
+
+// walks both trees in step, appending in the order the top-down build does
+void ErrorTree::extractNode(double threshold, const QuadTreeNode& source, QuadTree& tree, const QuadTreeNode& target) const {
+    const uint32_t index = source.getIndex();
+    tree.setColor(target.getIndex(), full.getPacked(index).color);
+    if (source.isLeaf() || !(errors[index] > threshold)) {
+        return;
+    }
+    
+    tree.split(target.getIndex());
+    for (int i = 0; i < 4; ++i) {
+        extractNode(threshold, full.getChild(source, i), tree, tree.getChild(target, i));
+    }
+}
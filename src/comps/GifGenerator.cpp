@@ -10,18 +10,17 @@ GifGenerator::~GifGenerator() {
     // dtor
 }
 
-bool GifGenerator::generateGif(const QuadTree& quadTree, const string& outputPath) {
-    if (!quadTree.getRoot()) {
+bool GifGenerator::generateGif(const QuadTree& quadTree, const string& outputPath, const cv::Mat& finalImage) {
+    if (quadTree.empty()) {
         return false;
     }
     
-    auto root = quadTree.getRoot();
-    imageWidth = root->getWidth();
-    imageHeight = root->getHeight();
+    imageWidth = quadTree.getWidth();
+    imageHeight = quadTree.getHeight();
     
     try {
         string tempDir;
-
+        
         // simpan gambar perframe di temporary folder
         #ifdef _WIN32 // windows
             tempDir = "temp_quadtree_frames";
@@ -32,40 +31,27 @@ bool GifGenerator::generateGif(const QuadTree& quadTree, const string& outputPat
             system(("rm -rf " + tempDir + " && mkdir -p " + tempDir).c_str());
         #endif
         
-        frames.clear();
-        
         int maxFrames = 80;
         int depthLimit = quadTree.getDepth();
+        bool reuseFinal = !finalImage.empty() && finalImage.cols == imageWidth && finalImage.rows == imageHeight;
         
+        // one frame buffer, every depth cut covers the whole image so no clear is needed
+        cv::Mat frame(imageHeight, imageWidth, CV_8UC3);
         for (int depth = 0; depth <= depthLimit; ++depth) {
-            // buat frame sesuai dengan depth
-            Frame frame;
-            frame.width = imageWidth;
-            frame.height = imageHeight;
-            
-            frame.pixels.resize(imageHeight, vector<Pixel>(imageWidth, Pixel(255, 255, 255)));
-            
-            // Fill frame sesuai sama node relatif terhadap depth
-            renderTreeAtDepth(frame, quadTree.getRoot(), depth);
-            frames.push_back(frame);
-        }
-        
-        // Save frames
-        for (size_t i = 0; i < frames.size(); ++i) {
-            cv::Mat cvFrame(frames[i].height, frames[i].width, CV_8UC3);
-            
-            for (int y = 0; y < frames[i].height; ++y) {
-                for (int x = 0; x < frames[i].width; ++x) {
-                    cv::Vec3b& color = cvFrame.at<cv::Vec3b>(y, x);
-                    color[0] = frames[i].pixels[y][x].b;
-                    color[1] = frames[i].pixels[y][x].g;
-                    color[2] = frames[i].pixels[y][x].r;
-                }
+            // from the deepest level on every leaf is drawn: that frame is the output image
+            bool complete = depth >= depthLimit - 1;
+            const cv::Mat* image = &frame;
+            if (complete && reuseFinal) {
+                image = &finalImage;
+            } else {
+                // Fill frame sesuai sama node relatif terhadap depth
+                renderTreeAtDepth(frame, quadTree, depth);
             }
             
+            // Save frame
             stringstream ss;
-            ss << tempDir << "/frame_" << setw(5) << setfill('0') << i << ".png";
-            cv::imwrite(ss.str(), cvFrame);
+            ss << tempDir << "/frame_" << setw(5) << setfill('0') << depth << ".png";
+            cv::imwrite(ss.str(), *image);
         }
         
         string cmd;
@@ -139,35 +125,31 @@ bool GifGenerator::generateGif(const QuadTree& quadTree, const string& outputPat
     }
 }
 
-void GifGenerator::renderTreeAtDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, int targetDepth, int currentDepth) {
-    if (!node) return;
-    
+void GifGenerator::renderTreeAtDepth(cv::Mat& frame, const QuadTree& tree, const QuadTreeNode& node, int targetDepth, int currentDepth) {
     // If we've reached a leaf node or the target depth, draw this node
-    if (node->isLeaf() || currentDepth == targetDepth) {
+    if (node.isLeaf() || currentDepth == targetDepth) {
         drawNode(frame, node);
     } 
-
+    
     // continue recursing if not
     else if (currentDepth < targetDepth) {
-        for (const auto& child : node->getChildren()) {
-            renderTreeAtDepth(frame, child, targetDepth, currentDepth + 1);
+        for (int i = 0; i < 4; ++i) {
+            renderTreeAtDepth(frame, tree, tree.getChild(node, i), targetDepth, currentDepth + 1);
         }
     }
 }
 
-void GifGenerator::renderTreeAtDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, int targetDepth) {
-    renderTreeAtDepth(frame, node, targetDepth, 0);
+void GifGenerator::renderTreeAtDepth(cv::Mat& frame, const QuadTree& tree, int targetDepth) {
+    renderTreeAtDepth(frame, tree, tree.getRoot(), targetDepth, 0);
 }
 
-void GifGenerator::renderPartialDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, int baseDepth, int nextDepth, float progress) {
-    if (!node) return;
-    
-    if (node->isLeaf()) {
+void GifGenerator::renderPartialDepth(cv::Mat& frame, const QuadTree& tree, const QuadTreeNode& node, int baseDepth, int nextDepth, float progress) {
+    if (node.isLeaf()) {
         drawNode(frame, node);
         return;
     }
     
-    int nodeDepth = getNodeDepth(node);
+    int nodeDepth = getNodeDepth(tree, node);
     
     // Draw all nodes up to baseDepth
     if (nodeDepth <= baseDepth) {
@@ -177,14 +159,14 @@ void GifGenerator::renderPartialDepth(Frame& frame, const shared_ptr<QuadTreeNod
                 drawNode(frame, node);
             } else {
                 // show children
-                for (const auto& child : node->getChildren()) {
-                    drawNode(frame, child);
+                for (int i = 0; i < 4; ++i) {
+                    drawNode(frame, tree.getChild(node, i));
                 }
             }
         } else {
             // if below base depth, recurse to children
-            for (const auto& child : node->getChildren()) {
-                renderPartialDepth(frame, child, baseDepth, nextDepth, progress);
+            for (int i = 0; i < 4; ++i) {
+                renderPartialDepth(frame, tree, tree.getChild(node, i), baseDepth, nextDepth, progress);
             }
         }
     } else {
@@ -192,32 +174,36 @@ void GifGenerator::renderPartialDepth(Frame& frame, const shared_ptr<QuadTreeNod
     }
 }
 
-int GifGenerator::getNodeDepth(const shared_ptr<QuadTreeNode>& node) {
-    if (!node) return 0;
-    if (node->isLeaf()) return 0;
+int GifGenerator::getNodeDepth(const QuadTree& tree, const QuadTreeNode& node) {
+    if (node.isLeaf()) return 0;
     
     int maxChildDepth = 0;
-    for (const auto& child : node->getChildren()) {
-        maxChildDepth = max(maxChildDepth, getNodeDepth(child));
+    for (int i = 0; i < 4; ++i) {
+        maxChildDepth = max(maxChildDepth, getNodeDepth(tree, tree.getChild(node, i)));
     }
     
     return 1 + maxChildDepth;
 }
 
-void GifGenerator::drawNode(Frame& frame, const shared_ptr<QuadTreeNode>& node) {
-    if (!node) return;
+void GifGenerator::drawNode(cv::Mat& frame, const QuadTreeNode& node) {
+    Pixel color = node.getColor();
+    int x = node.getX();
+    int y = node.getY();
+    int width = node.getWidth();
+    int height = node.getHeight();
     
-    Pixel color = node->getColor();
-    int x = node->getX();
-    int y = node->getY();
-    int width = node->getWidth();
-    int height = node->getHeight();
+    // clip once, then fill rows directly
+    int left = max(0, x);
+    int top = max(0, y);
+    int right = min(x + width, frame.cols);
+    int bottom = min(y + height, frame.rows);
     
-    for (int j = y; j < y + height; ++j) {
-        for (int i = x; i < x + width; ++i) {
-            if (j >= 0 && i >= 0 && j < frame.height && i < frame.width) {
-                frame.pixels[j][i] = color;
-            }
+    for (int j = top; j < bottom; ++j) {
+        cv::Vec3b* row = frame.ptr<cv::Vec3b>(j);
+        for (int i = left; i < right; ++i) {
+            row[i][0] = color.b;
+            row[i][1] = color.g;
+            row[i][2] = color.r;
         }
     }
 }
\ No newline at end of file
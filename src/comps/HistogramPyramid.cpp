@@ -0,0 +1,56 @@
+// include header file
+#include "HistogramPyramid.hpp"
+
+
+// finest level keeps at least this many pixels per cell on average (about 3 bytes per pixel)
+static const uint64_t MIN_PIXELS_PER_CELL = 1024;
+
+
+// pyramid builder
+void HistogramPyramid::build(const ImageView& image) {
+    int finest = QuadGrid::finestLevelFor(image.getWidth(), image.getHeight(), MIN_PIXELS_PER_CELL);
+    grid.build(image.getWidth(), image.getHeight(), finest + 1);
+    cells.assign(finest + 1, vector<ChannelHistogram>());
+    
+    // finest level from the pixels (zeroed cells for empty intervals)
+    size_t side = grid.getSide(finest);
+    cells[finest].assign(side * side, ChannelHistogram());
+    for (size_t cy = 0; cy < side; ++cy) {
+        if (grid.getHeight(finest, cy) == 0) continue;
+        for (size_t cx = 0; cx < side; ++cx) {
+            if (grid.getWidth(finest, cx) == 0) continue;
+            ErrorKernels::blockHistogram(image, grid.getX(finest, cx), grid.getY(finest, cy),
+                                         grid.getWidth(finest, cx), grid.getHeight(finest, cy), cells[finest][cy * side + cx]);
+        }
+    }
+    
+    // coarser levels add up their 2x2 children
+    for (int d = finest - 1; d >= 0; --d) {
+        cells[d].assign(grid.getCellCount(d), ChannelHistogram());
+        for (size_t i = 0; i < cells[d].size(); ++i) {
+            uint32_t* bins = &cells[d][i].bins[0][0];
+            for (int k = 0; k < 4; ++k) {
+                const uint32_t* child = &cells[d + 1][grid.childCell(d, i, k)].bins[0][0];
+                for (int v = 0; v < 3 * 256; ++v) {
+                    bins[v] += child[v];
+                }
+            }
+        }
+    }
+}
+
+void HistogramPyramid::clear() {
+    grid.clear();
+    cells.clear();
+    cells.shrink_to_fit();
+}
+
+// O(1) block lookup
+const ChannelHistogram* HistogramPyramid::query(int x, int y, int width, int height) const {
+    int level;
+    size_t cell;
+    if (!grid.locate(x, y, width, height, level, cell)) {
+        return nullptr;
+    }
+    return &cells[level][cell];
+}
@@ -0,0 +1,87 @@
+// include header file
+#include "ImageBuffer.hpp"
+
+
+ImageBuffer::ImageBuffer(): offset(0), external(nullptr), width(0), height(0), stride(0) {
+    // cons
+}
+
+ImageBuffer::ImageBuffer(int width, int height, const Pixel& fillColor): ImageBuffer() {
+    allocate(width, height);
+    fill(fillColor);
+}
+
+ImageBuffer::ImageBuffer(const ImageBuffer& other): ImageBuffer() {
+    *this = other;
+}
+
+ImageBuffer& ImageBuffer::operator=(const ImageBuffer& other) {
+    if (this == &other) {
+        return *this;
+    }
+    
+    // a copied vector may land on a different alignment, so copy row by row
+    allocate(other.width, other.height);
+    for (int y = 0; y < height; ++y) {
+        memcpy(row(y), other.row(y), static_cast<size_t>(width) * sizeof(Pixel));
+    }
+    return *this;
+}
+
+// storage allocator (one block for the whole image)
+void ImageBuffer::allocate(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        release();
+        return;
+    }
+    
+    external = nullptr;
+    owner.reset();
+    this->width = width;
+    this->height = height;
+    
+    // pad every row to the alignment so each row starts on a cache line
+    size_t rowBytes = static_cast<size_t>(width) * sizeof(Pixel);
+    stride = (rowBytes + ROW_ALIGNMENT - 1) / ROW_ALIGNMENT * ROW_ALIGNMENT;
+    
+    storage.assign(stride * height + ROW_ALIGNMENT, 0);
+    size_t address = reinterpret_cast<size_t>(storage.data());
+    offset = (ROW_ALIGNMENT - address % ROW_ALIGNMENT) % ROW_ALIGNMENT;
+}
+
+// rows stay where they are, the buffer only shares their ownership
+void ImageBuffer::adopt(unsigned char* data, int width, int height, size_t stride, shared_ptr<void> owner) {
+    if (data == nullptr || width <= 0 || height <= 0) {
+        release();
+        return;
+    }
+    
+    storage.clear();
+    storage.shrink_to_fit();
+    offset = 0;
+    external = data;
+    this->owner = move(owner);
+    this->width = width;
+    this->height = height;
+    this->stride = stride;
+}
+
+void ImageBuffer::fill(const Pixel& color) {
+    for (int y = 0; y < height; ++y) {
+        Pixel* line = row(y);
+        for (int x = 0; x < width; ++x) {
+            line[x] = color;
+        }
+    }
+}
+
+void ImageBuffer::release() {
+    storage.clear();
+    storage.shrink_to_fit();
+    offset = 0;
+    external = nullptr;
+    owner.reset();
+    width = 0;
+    height = 0;
+    stride = 0;
+}
@@ -2,7 +2,7 @@
 #include "ImageProcessor.hpp"
 
 
-ImageProcessor::ImageProcessor(const CompressionParams& params): params(params), imageWidth(0), imageHeight(0), originalImageSize(0), compressedImageSize(0) {
+ImageProcessor::ImageProcessor(const CompressionParams& params): params(params), imageWidth(0), imageHeight(0), originalImageSize(0), compressedImageSize(0), renderedVersion(0) {
     // cons
     
     initializeErrorCalculator();
@@ -28,6 +28,16 @@ void ImageProcessor::initializeErrorCalculator() {
         cerr << "Failed to create error calculator. Using default Variance method." << endl;
         errorCalculator = make_unique<VarianceErrorCalculator>();
     }
+    
+    if (params.buildMode == BuildMode::BOTTOM_UP && !errorCalculator->supportsStatsMerging()) {
+        cout << "Bottom-up build is not available for this error method. Using top-down build." << endl;
+        params.buildMode = BuildMode::TOP_DOWN;
+    }
+    
+    if (params.hasBuildBudget() && params.buildMode != BuildMode::BEST_FIRST) {
+        cout << "Build budget given. Using best-first build." << endl;
+        params.buildMode = BuildMode::BEST_FIRST;
+    }
 }
 
 
@@ -83,18 +93,34 @@ bool ImageProcessor::loadImage(const string& imagePath) {
         
         originalImageSize = getFileSize(imagePath);
         
-        // Convert to pixel
-        pixels.clear();
-        pixels.resize(imageHeight, vector<Pixel>(imageWidth));
-        
+        // Convert to pixel: bgr -> rgb in the decoded rows, which the buffer then adopts
+        // (no second copy of the image)
         for (int y = 0; y < imageHeight; ++y) {
-            for (int x = 0; x < imageWidth; ++x) {
-                cv::Vec3b color = image.at<cv::Vec3b>(y, x);
-                pixels[y][x] = Pixel(color[2], color[1], color[0]);
-            }
+            ErrorKernels::swapRedBlue(image.ptr<unsigned char>(y), imageWidth);
         }
+        auto decoded = make_shared<cv::Mat>(image);
+        pixels.adopt(decoded->ptr<unsigned char>(0), imageWidth, imageHeight, static_cast<size_t>(decoded->step), decoded);
         
         cout << "Image converted to internal format" << endl;
+        
+        // Summed-area tables for metrics with O(1) region queries
+        integralImage.clear();
+        if (errorCalculator && errorCalculator->requiresIntegralImage()) {
+            integralImage.build(pixels.view());
+            errorCalculator->setIntegralImage(&integralImage);
+        }
+        
+        minMaxPyramid.clear();
+        if (errorCalculator && errorCalculator->requiresMinMaxPyramid()) {
+            minMaxPyramid.build(pixels.view());
+            errorCalculator->setMinMaxPyramid(&minMaxPyramid);
+        }
+        
+        histogramPyramid.clear();
+        if (errorCalculator && errorCalculator->requiresHistogramPyramid()) {
+            histogramPyramid.build(pixels.view());
+            errorCalculator->setHistogramPyramid(&histogramPyramid);
+        }
 
         adjustMinimumBlockSize();
         return true;
@@ -125,21 +151,21 @@ QuadTree ImageProcessor::compressImage() {
         }
         
         cout << "Building quadtree..." << endl;
-        shared_ptr<QuadTreeNode> root = buildQuadTree(0, 0, imageWidth, imageHeight, 0);
-        
-        if (!root) {
+        if (!errorTree.empty()) {
+            // the search already holds every block's error
+            errorTree.extract(params.threshold, tree);
+            errorTree.clear();
+        } else if (!buildQuadTreeRoot(tree, params.threshold)) {
             cerr << "Failed to build quadtree root" << endl;
             return tree;
         }
         
-        tree.setRoot(root);
-        tree.calculateDepthAndNodeCount();
-        
         cout << "QuadTree built successfully: " 
                   << "depth=" << tree.getDepth() 
                   << ", nodes=" << tree.getNodeCount() << endl;
         
-        compressedImageSize = calculateTheoricalCompressedSize(tree);
+        // the encoded size is known once the image is saved
+        compressedImageSize = 0;
         
         quadTree = tree;
         
@@ -159,142 +185,354 @@ bool ImageProcessor::isValidRegion(int x, int y, int width, int height) const {
 }
 
 
-// main algo (recursive quadtree compression)
-shared_ptr<QuadTreeNode> ImageProcessor::buildQuadTree(int x, int y, int width, int height, int depth) {
-    // Create a new node for this region
-    auto node = make_shared<QuadTreeNode>(x, y, width, height);
-    
-    // Set the average color for this node ()
-    node->setColor(calculateAverageColor(x, y, width, height));
+// blocks smaller than this are built sequentially inside one task
+static const uint64_t PARALLEL_BLOCK_CUTOFF = 1 << 14;
+
+// best-first builds against a byte budget, each one refines the size model with the last miss
+static const int MAX_BUDGET_ROUNDS = 4;
+
+
+// shared by every build, created on first use
+WorkStealingPool* ImageProcessor::getBuildPool() {
+    unsigned threads = params.threadCount > 0 ? static_cast<unsigned>(params.threadCount) : thread::hardware_concurrency();
+    if (threads <= 1) {
+        return nullptr;
+    }
+    if (!buildPool || buildPool->getThreadCount() != threads) {
+        buildPool = make_unique<WorkStealingPool>(threads);
+    }
+    return buildPool.get();
+}
+
+
+// build the whole tree with the configured strategy
+bool ImageProcessor::buildQuadTreeRoot(QuadTree& tree, double threshold) {
+    tree.reset(imageWidth, imageHeight);
     
-    double error = 0.0;
-    bool shouldDivide = shouldSubdivide(x, y, width, height, error); // checker for subdivide, relatif berdasarkan threshold
+    if (params.buildMode == BuildMode::BOTTOM_UP) {
+        BlockStats stats;
+        buildQuadTreeBottomUp(tree, tree.getRoot(), 0, threshold, stats);
+        return true;
+    }
     
-    // partisi blok
-    int halfWidth = width / 2;
-    int remainderWidth = width - halfWidth;
-    int halfHeight = height / 2;
-    int remainderHeight = height - halfHeight;
-    int subBlockArea = halfWidth * halfHeight;
+    if (params.buildMode == BuildMode::BEST_FIRST) {
+        try {
+            if (params.metricDispatch == MetricDispatch::STATIC) {
+                ErrorCalculator::dispatch(*errorCalculator, [this, &tree, threshold](auto& metric) {
+                    buildQuadTreeBestFirst(metric, tree, threshold);
+                });
+            } else {
+                buildQuadTreeBestFirst(*errorCalculator, tree, threshold);
+            }
+            return true;
+        } catch (const exception& e) {
+            cerr << "Exception in best-first build: " << e.what() << endl;
+            return false;
+        }
+    }
     
-    // subdivision algo
-    if (shouldDivide && subBlockArea >= params.minBlockSize) {
-        auto topLeft = buildQuadTree(x, y, halfWidth, halfHeight, depth + 1);
-        auto topRight = buildQuadTree(x + halfWidth, y, remainderWidth, halfHeight, depth + 1);
-        auto bottomLeft = buildQuadTree(x, y + halfHeight, halfWidth, remainderHeight, depth + 1);
-        auto bottomRight = buildQuadTree(x + halfWidth, y + halfHeight, remainderWidth, remainderHeight, depth + 1);
-        
-        // valid children
-        if (topLeft) node->addChild(topLeft);
-        if (topRight) node->addChild(topRight);
-        if (bottomLeft) node->addChild(bottomLeft);
-        if (bottomRight) node->addChild(bottomRight);
+    if (!errorCalculator) {
+        buildQuadTree(tree, tree.getRoot(), 0, threshold);
+        return true;
     }
     
-    return node;
+    bool specialized = params.metricDispatch == MetricDispatch::STATIC;
+    bool parallel = getBuildPool() != nullptr;
+    if (specialized || parallel) {
+        try {
+            if (specialized) {
+                ErrorCalculator::dispatch(*errorCalculator, [this, &tree, parallel, threshold](auto& metric) {
+                    if (parallel) {
+                        buildQuadTreeParallel(metric, tree, tree.getRoot(), 0, threshold);
+                    } else {
+                        buildQuadTreeWith(metric, tree, tree.getRoot(), 0, threshold);
+                    }
+                });
+            } else {
+                // virtual calls per node, only the recursion is shared with the specialized path
+                buildQuadTreeParallel(*errorCalculator, tree, tree.getRoot(), 0, threshold);
+            }
+            return true;
+        } catch (const exception& e) {
+            cerr << "Exception in " << (parallel ? "parallel" : "specialized") << " build, using the sequential path: " << e.what() << endl;
+            tree.reset(imageWidth, imageHeight);
+        }
+    }
+    buildQuadTree(tree, tree.getRoot(), 0, threshold);
+    return true;
 }
 
-// checker if region should be subdivided
-bool ImageProcessor::shouldSubdivide(int x, int y, int width, int height, double& error) {
-    if (!errorCalculator) {
-        cerr << "Error calculator is null" << endl;
-        return false;
-    }
+
+// node color and split decision, shared by the templated builders
+template <typename Metric>
+bool ImageProcessor::evaluateBlock(Metric& metric, QuadTree& tree, const QuadTreeNode& node, double threshold, RegionStats& stats) const {
+    const int x = node.getX(), y = node.getY(), width = node.getWidth(), height = node.getHeight();
     
-    if (!isValidRegion(x, y, width, height)) {
-        return false;
+    stats = {Pixel(0, 0, 0), 0.0, 0};
+    if (isValidRegion(x, y, width, height)) {
+        stats = metric.calculateRegionStats(pixels.view(), x, y, width, height);
     }
+    tree.setColor(node.getIndex(), stats.meanColor);
     
-    try {
-        error = errorCalculator->calculateError(pixels, x, y, width, height);
-        
-        return error > params.threshold;
-    } catch (const exception& e) {
-        cerr << "Exception in shouldSubdivide: " << e.what() << endl;
-        return false;
-    } catch (...) {
-        cerr << "Unknown exception in shouldSubdivide" << endl;
-        return false;
+    // partisi blok
+    int subBlockArea = (width / 2) * (height / 2);
+    return stats.error > threshold && subBlockArea >= params.minBlockSize;
+}
+
+
+// same recursion as buildQuadTree with the metric type known at compile time: the
+// region stats call binds statically (final classes) and inlines into the recursion.
+// Exceptions propagate to buildQuadTreeRoot instead of being caught per node
+template <typename Metric>
+void ImageProcessor::buildQuadTreeWith(Metric& metric, QuadTree& tree, const QuadTreeNode& node, int depth, double threshold) {
+    RegionStats stats;
+    if (evaluateBlock(metric, tree, node, threshold, stats)) {
+        tree.split(node.getIndex());
+        for (int i = 0; i < 4; ++i) {
+            buildQuadTreeWith(metric, tree, tree.getChild(node, i), depth + 1, threshold);
+        }
     }
 }
 
-// color normalization
-Pixel ImageProcessor::calculateAverageColor(int x, int y, int width, int height) {
-    if (!isValidRegion(x, y, width, height)) {
-        return Pixel(0, 0, 0);
+
+// parallel variant: a large block builds its four children as separate fragments on the
+// work-stealing pool, then attaches them in quadrant order. Fragments hold exactly the
+// nodes a sequential build would append after the child block, so the arena is identical
+template <typename Metric>
+void ImageProcessor::buildQuadTreeParallel(Metric& metric, QuadTree& tree, const QuadTreeNode& node, int depth, double threshold) {
+    if (static_cast<uint64_t>(node.getWidth()) * node.getHeight() < PARALLEL_BLOCK_CUTOFF) {
+        buildQuadTreeWith(metric, tree, node, depth, threshold);
+        return;
     }
     
-    long totalR = 0, totalG = 0, totalB = 0;
-    int count = width * height;
+    RegionStats stats;
+    if (!evaluateBlock(metric, tree, node, threshold, stats)) {
+        return;
+    }
     
-    if (count <= 0) {
-        return Pixel(0, 0, 0);
+    tree.split(node.getIndex());
+    QuadTree fragments[4];
+    WorkStealingPool::TaskGroup group;
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(node, i);
+        fragments[i].resetBlock(child.getX(), child.getY(), child.getWidth(), child.getHeight(), depth + 1);
+        buildPool->spawn(group, [this, &metric, &fragments, i, depth, threshold] {
+            buildQuadTreeParallel(metric, fragments[i], fragments[i].getRoot(), depth + 1, threshold);
+        });
     }
+    buildPool->wait(group);
     
-    try {
-        for (int j = y; j < y + height; ++j) {
-            for (int i = x; i < x + width; ++i) {
-                totalR += pixels[j][i].r;
-                totalG += pixels[j][i].g;
-                totalB += pixels[j][i].b;
+    for (int i = 0; i < 4; ++i) {
+        tree.attach(tree.getChild(node, i).getIndex(), fragments[i]);
+    }
+}
+
+
+// best-first build: the splittable leaf with the highest error is split next, until no leaf
+// is above the threshold or the next split would go over a budget. The split rule is the
+// top-down one, so without a budget both builds produce the same leaves.
+// The byte budget is steered by a size model of the output format: the growing tree is
+// encoded each time its run count doubles and every split is checked against the predicted
+// size. The finished tree is encoded too; while it is still over, the build runs again with
+// that sample in the model (the build is deterministic, earlier samples stay valid)
+template <typename Metric>
+void ImageProcessor::buildQuadTreeBestFirst(Metric& metric, QuadTree& tree, double threshold) {
+    struct Candidate {
+        double error;
+        QuadTreeNode node;
+        
+        // max-heap on error, earlier arena index first on ties
+        bool operator<(const Candidate& other) const {
+            if (error != other.error) {
+                return error < other.error;
             }
+            return node.getIndex() > other.node.getIndex();
         }
+    };
+    
+    const bool byteBudget = params.maxBytes > 0;
+    size_t dot = params.outputImagePath.find_last_of('.');
+    string extension = byteBudget && dot != string::npos ? params.outputImagePath.substr(dot) : string();
+    SizePredictor model;
+    uint64_t calibratedRuns = 0;
+    size_t goal = params.maxBytes; // predicted size the splits stop at
+    vector<unsigned char> buffer;
+    
+    for (int round = 1; ; ++round) {
+        tree.reset(imageWidth, imageHeight);
+        priority_queue<Candidate> candidates;
+        RegionStats stats;
+        QuadTreeNode root = tree.getRoot();
+        if (evaluateBlock(metric, tree, root, threshold, stats)) {
+            candidates.push({stats.error, root});
+        }
+        TreeFeatures features = {static_cast<uint64_t>(root.getHeight()), static_cast<uint64_t>(root.getWidth())};
         
-        return Pixel(
-            static_cast<unsigned char>(totalR / count),
-            static_cast<unsigned char>(totalG / count),
-            static_cast<unsigned char>(totalB / count)
-        );
-    } catch (const exception& e) {
-        cerr << "Exception in calculateAverageColor: " << e.what() << endl;
-        return Pixel(0, 0, 0);
+        while (!candidates.empty()) {
+            if (byteBudget && features.rowRuns + features.columnRuns >= 2 * calibratedRuns) {
+                if (!encodeTree(tree, extension, buffer)) {
+                    cerr << "Byte budget needs an encodable output format, build stopped" << endl;
+                    return;
+                }
+                model.addSample(features, buffer.size());
+                calibratedRuns = features.rowRuns + features.columnRuns;
+            }
+            
+            // a split turns one leaf into four, each row and column of the block gains a run
+            QuadTreeNode node = candidates.top().node;
+            TreeFeatures next = {features.rowRuns + node.getHeight(), features.columnRuns + node.getWidth()};
+            if (exceedsBuildBudget(tree.getLeafCount() + 3, tree.getNodeCount() + 4) || (byteBudget && model.predict(next) > goal)) {
+                break;
+            }
+            
+            candidates.pop();
+            tree.split(node.getIndex());
+            features = next;
+            for (int i = 0; i < 4; ++i) {
+                QuadTreeNode child = tree.getChild(node, i);
+                if (evaluateBlock(metric, tree, child, threshold, stats)) {
+                    candidates.push({stats.error, child});
+                }
+            }
+        }
+        
+        if (!byteBudget) {
+            return;
+        }
+        if (!encodeTree(tree, extension, buffer) || buffer.size() <= params.maxBytes) {
+            return;
+        }
+        if (round == MAX_BUDGET_ROUNDS) {
+            cerr << "Byte budget missed after " << round << " builds: " << buffer.size() << " bytes" << endl;
+            return;
+        }
+        // sizes are not smooth in the run count (palette cuts, deflate windows), so the next
+        // build also aims below the budget by the share it was missed by
+        model.addSample(features, buffer.size());
+        calibratedRuns = max(calibratedRuns, features.rowRuns + features.columnRuns);
+        goal = static_cast<size_t>(static_cast<double>(goal) * params.maxBytes / buffer.size());
     }
 }
 
+// leaf and node budgets of the best-first build, the byte budget is checked against the size model
+bool ImageProcessor::exceedsBuildBudget(size_t leafCount, size_t nodeCount) const {
+    return (params.maxLeaves > 0 && leafCount > params.maxLeaves) ||
+           (params.maxNodes > 0 && nodeCount > params.maxNodes);
+}
 
-// compress fuzz (for targetted compression)
-double ImageProcessor::compressWithThreshold(double threshold) {
-    // Save original threshold (from input)
-    double originalThreshold = params.threshold;
+// main algo (recursive quadtree compression)
+// the node already exists in the arena (root or part of its parent's child block)
+void ImageProcessor::buildQuadTree(QuadTree& tree, const QuadTreeNode& node, int depth, double threshold) {
+    const uint32_t index = node.getIndex();
+    const int x = node.getX(), y = node.getY(), width = node.getWidth(), height = node.getHeight();
     
-    params.threshold = threshold;
+    // average color and error from one pass over the block
+    RegionStats stats;
+    bool shouldDivide = shouldSubdivide(x, y, width, height, threshold, stats); // checker for subdivide, relatif berdasarkan threshold
+    tree.setColor(index, stats.meanColor);
     
-    // Build test tree
-    shared_ptr<QuadTreeNode> tempRoot = buildQuadTree(0, 0, imageWidth, imageHeight, 0);
+    // partisi blok (tree.getChild uses the same half/remainder partition)
+    int subBlockArea = (width / 2) * (height / 2);
     
-    if (!tempRoot) {
-        params.threshold = originalThreshold;
-        return 0.0;
+    // subdivision algo, children are appended as one block of 4 (tl, tr, bl, br)
+    if (shouldDivide && subBlockArea >= params.minBlockSize) {
+        tree.split(index);
+        for (int i = 0; i < 4; ++i) {
+            buildQuadTree(tree, tree.getChild(node, i), depth + 1, threshold);
+        }
     }
+}
+
+// bottom-up variant: children report their statistics, the parent merges them
+// so every pixel is read once no matter how deep the tree goes.
+// The child block is appended speculatively and dropped again when the merged block
+// stays a leaf; subtrees are appended depth first, so that is a plain truncation
+void ImageProcessor::buildQuadTreeBottomUp(QuadTree& tree, const QuadTreeNode& node, int depth, double threshold, BlockStats& stats) {
+    const uint32_t index = node.getIndex();
+    const int x = node.getX(), y = node.getY(), width = node.getWidth(), height = node.getHeight();
     
-    QuadTree testTree;
-    testTree.setRoot(tempRoot);
-    testTree.calculateDepthAndNodeCount();
+    // partisi blok
+    int subBlockArea = (width / 2) * (height / 2);
     
-    // Calculate the theoretical compressed size
-    size_t estimatedCompressedSize = calculateTheoricalCompressedSize(testTree);
+    if (subBlockArea < params.minBlockSize) {
+        // smallest blocks are the only ones that read pixels
+        ErrorKernels::blockStats(pixels.view(), x, y, width, height, stats);
+        tree.setColor(index, averageColorFromStats(stats));
+        return;
+    }
     
-    const size_t MIN_FILE_SIZE = 1024;
-    estimatedCompressedSize = max(estimatedCompressedSize, MIN_FILE_SIZE);
+    tree.split(index);
+    BlockStats childStats[4];
+    for (int i = 0; i < 4; ++i) {
+        buildQuadTreeBottomUp(tree, tree.getChild(node, i), depth + 1, threshold, childStats[i]);
+    }
     
-    // Calculate compression percentage
-    double compressionRatio = 0.0;
-    if (originalImageSize > 0) {
-        compressionRatio = 1.0 - (static_cast<double>(estimatedCompressedSize) / static_cast<double>(originalImageSize));
+    stats = childStats[0];
+    for (int i = 1; i < 4; ++i) {
+        stats.merge(childStats[i]);
     }
+    tree.setColor(index, averageColorFromStats(stats));
     
-    // Apply a correction factor based on empirical observation
+    // same decision as the top-down build
+    if (errorCalculator->calculateErrorFromStats(stats) <= threshold) {
+        tree.collapse(index);
+    }
+}
 
-    double correctionFactor = 0.7;  // Reduce expected compression
-    compressionRatio *= correctionFactor;
+// truncated mean color, same rounding as the top-down build
+Pixel ImageProcessor::averageColorFromStats(const BlockStats& stats) const {
+    return ErrorCalculator::meanColor(stats.moments);
+}
+
+// checker if region should be subdivided
+bool ImageProcessor::shouldSubdivide(int x, int y, int width, int height, double threshold, RegionStats& stats) {
+    stats = {Pixel(0, 0, 0), 0.0, 0};
     
-    // Bound the result to valid range
-    compressionRatio = max(0.0, min(0.99, compressionRatio));
+    if (!errorCalculator) {
+        cerr << "Error calculator is null" << endl;
+        return false;
+    }
+    
+    if (!isValidRegion(x, y, width, height)) {
+        return false;
+    }
+    
+    try {
+        stats = errorCalculator->calculateRegionStats(pixels.view(), x, y, width, height);
+        
+        return stats.error > threshold;
+    } catch (const exception& e) {
+        cerr << "Exception in shouldSubdivide: " << e.what() << endl;
+        return false;
+    } catch (...) {
+        cerr << "Unknown exception in shouldSubdivide" << endl;
+        return false;
+    }
+}
+
+
+// full error tree for the target search, skipped when budgets change the build or it would not fit
+static const size_t MAX_ERROR_TREE_NODES = static_cast<size_t>(1) << 24;
+
+bool ImageProcessor::prepareErrorTree() {
+    errorTree.clear();
+    if (!params.useErrorTree || params.hasBuildBudget() || !errorCalculator) {
+        return false;
+    }
     
-    // Restore original threshold
-    params.threshold = originalThreshold;
+    if (ErrorTree::estimateNodeCount(imageWidth, imageHeight, params.minBlockSize) > MAX_ERROR_TREE_NODES) {
+        cout << "Image too large for a full error tree. Rebuilding the quadtree per probe." << endl;
+        return false;
+    }
     
-    return compressionRatio;
+    try {
+        errorTree.build(*errorCalculator, pixels.view(), params.minBlockSize);
+        return true;
+    } catch (const exception& e) {
+        cerr << "Exception building the error tree: " << e.what() << endl;
+        errorTree.clear();
+        return false;
+    }
 }
 
 
@@ -324,38 +562,85 @@ double ImageProcessor::findThresholdForTargetCompression(double targetPercentage
             break;
     }
     
-    mutex mtx;
+    // with the error tree a probe is a cut of it, and probes with the same leaf count
+    // share the same tree, so their ratio is only measured once
+    prepareErrorTree();
+    map<int, double> ratioByLeafCount;
+    mutex cacheLock;
+    
+    // created up front, probes only share it
+    getBuildPool();
+    
+    // every encode calibrates the size predictor; once calibrated the search runs on
+    // predicted ratios and only the threshold it settles on is encoded again
+    SizePredictor predictor;
+    map<double, TreeFeatures> featuresByThreshold; // thresholds whose cached ratio is a prediction
     
     unsigned int systemThreads = thread::hardware_concurrency();
     unsigned int numThreads = max(3u, systemThreads > 1 ? systemThreads - 1 : 1);
     
-    auto getCompressionRatio = [this, &extension, &mtx](double thresh) -> double {
-        lock_guard<mutex> lock(mtx);
-        double oldThreshold = params.threshold;
-        params.threshold = thresh;
-        
-        shared_ptr<QuadTreeNode> localRoot = buildQuadTree(0, 0, imageWidth, imageHeight, 0);
-        if (!localRoot) {
-            params.threshold = oldThreshold;
+    // each probe owns its tree and encode buffer; pixels, tables and the error tree
+    // are only read, so probes run concurrently
+    auto getCompressionRatio = [this, &extension, &cacheLock, &ratioByLeafCount, &predictor](double thresh) -> double {
+        QuadTree localTree;
+        int leafCount = 0;
+        if (!errorTree.empty()) {
+            leafCount = errorTree.countLeaves(thresh);
+            {
+                lock_guard<mutex> lock(cacheLock);
+                auto known = ratioByLeafCount.find(leafCount);
+                if (known != ratioByLeafCount.end()) {
+                    return known->second;
+                }
+            }
+            errorTree.extract(thresh, localTree);
+        } else if (!buildQuadTreeRoot(localTree, thresh)) {
             return -1.0;
         }
         
-        QuadTree localTree;
-        localTree.setRoot(localRoot);
-        localTree.calculateDepthAndNodeCount();
-        this->quadTree = localTree;
-        
         vector<unsigned char> buffer;
-        if (!saveCompressedImageToBuffer(extension, buffer)) {
-            params.threshold = oldThreshold;
+        if (!encodeTree(localTree, extension, buffer)) {
             return -1.0;
         }
         
         double compressionRatio = 1.0 - (static_cast<double>(buffer.size()) / originalImageSize);
-        params.threshold = oldThreshold;
+        TreeFeatures features = errorTree.empty() ? SizePredictor::measure(localTree) : errorTree.cutFeatures(thresh);
+        
+        lock_guard<mutex> lock(cacheLock);
+        if (!errorTree.empty()) {
+            ratioByLeafCount[leafCount] = compressionRatio;
+        }
+        predictor.addSample(features, buffer.size());
         return compressionRatio;
     };
     
+    // predicted ratio, encodes while the predictor is not calibrated yet
+    auto estimateCompressionRatio = [this, &cacheLock, &predictor, &featuresByThreshold, &getCompressionRatio](double thresh) -> double {
+        bool calibrated = false;
+        {
+            lock_guard<mutex> lock(cacheLock);
+            calibrated = params.useSizeModel && predictor.ready();
+        }
+        if (!calibrated) {
+            return getCompressionRatio(thresh);
+        }
+        
+        TreeFeatures features;
+        if (!errorTree.empty()) {
+            features = errorTree.cutFeatures(thresh);
+        } else {
+            QuadTree localTree;
+            if (!buildQuadTreeRoot(localTree, thresh)) {
+                return -1.0;
+            }
+            features = SizePredictor::measure(localTree);
+        }
+        
+        lock_guard<mutex> lock(cacheLock);
+        featuresByThreshold[thresh] = features;
+        return 1.0 - (static_cast<double>(predictor.predict(features)) / originalImageSize);
+    };
+    
     map<double, double> cache;
     
     const double tolerance = 1e-6; // tolerance
@@ -416,157 +701,197 @@ double ImageProcessor::findThresholdForTargetCompression(double targetPercentage
     
     // Binary search w/ multithread
     int iteration = 0;
-    while (iteration++ < maxIterations && bestDiff > tolerance) {
-        vector<pair<double, double>> points;
-        for (const auto& entry : cache) {
-            points.push_back({entry.first, entry.second});
-        }
-        sort(points.begin(), points.end());
-        
-        // Find the interval where our target compression ratio falls
-        bool foundInterval = false;
-        double leftT = lowT, rightT = highT;
-        
-        for (size_t i = 0; i < points.size() - 1; i++) {
-            double t1 = points[i].first;
-            double r1 = points[i].second;
-            double t2 = points[i + 1].first;
-            double r2 = points[i + 1].second;
+    int verifications = 0;
+    const int maxVerifications = 8;
+    while (true) {
+        while (iteration++ < maxIterations && bestDiff > tolerance) {
+            vector<pair<double, double>> points;
+            for (const auto& entry : cache) {
+                points.push_back({entry.first, entry.second});
+            }
+            sort(points.begin(), points.end());
             
-            bool inRange = (r1 <= r2 && targetPercentage >= r1 && targetPercentage <= r2) ||
-                           (r1 >= r2 && targetPercentage <= r1 && targetPercentage >= r2);
+            // Find the interval where our target compression ratio falls
+            bool foundInterval = false;
+            double leftT = lowT, rightT = highT;
             
-            if (inRange) {
-                leftT = t1;
-                rightT = t2;
-                foundInterval = true;
-                break;
-            }
-        }
-        
-        // Try to add more evaluation points
-        if (!foundInterval) {
-            vector<double> newPoints;
             for (size_t i = 0; i < points.size() - 1; i++) {
-                double mid = (points[i].first + points[i + 1].first) / 2.0;
-                if (cache.find(mid) == cache.end()) {
-                    newPoints.push_back(mid);
+                double t1 = points[i].first;
+                double r1 = points[i].second;
+                double t2 = points[i + 1].first;
+                double r2 = points[i + 1].second;
+                
+                bool inRange = (r1 <= r2 && targetPercentage >= r1 && targetPercentage <= r2) ||
+                               (r1 >= r2 && targetPercentage <= r1 && targetPercentage >= r2);
+                
+                if (inRange) {
+                    leftT = t1;
+                    rightT = t2;
+                    foundInterval = true;
+                    break;
                 }
             }
             
-            while (newPoints.size() > numThreads) {
-                // remove points from the smallest intervals first :3
+            // Try to add more evaluation points
+            if (!foundInterval) {
+                vector<double> newPoints;
+                for (size_t i = 0; i < points.size() - 1; i++) {
+                    double mid = (points[i].first + points[i + 1].first) / 2.0;
+                    if (cache.find(mid) == cache.end()) {
+                        newPoints.push_back(mid);
+                    }
+                }
+                
+                while (newPoints.size() > numThreads) {
+                    // remove points from the smallest intervals first :3
 
-                size_t minSpacingIdx = 0;
-                double minSpacing = numeric_limits<double>::max();
+                    size_t minSpacingIdx = 0;
+                    double minSpacing = numeric_limits<double>::max();
+                    
+                    for (size_t i = 0; i < newPoints.size(); i++) {
+                        size_t idx = 0;
+                        while (idx < points.size() && points[idx].first < newPoints[i]) {
+                            idx++;
+                        }
+                        
+                        double spacing = 0.0;
+                        if (idx > 0 && idx < points.size()) {
+                            spacing = points[idx].first - points[idx - 1].first;
+                        }
+                        
+                        if (spacing < minSpacing) {
+                            minSpacing = spacing;
+                            minSpacingIdx = i;
+                        }
+                    }
+                    
+                    newPoints.erase(newPoints.begin() + minSpacingIdx);
+                }
+                
+                if (newPoints.empty()) {
+                    break;
+                }
+                
+                // Evaluate new points in parallel
+                vector<future<double>> futures;
+                for (double point : newPoints) {
+                    futures.push_back(async(launch::async, estimateCompressionRatio, point));
+                }
                 
+                // Collect results
                 for (size_t i = 0; i < newPoints.size(); i++) {
-                    size_t idx = 0;
-                    while (idx < points.size() && points[idx].first < newPoints[i]) {
-                        idx++;
-                    }
+                    double ratio = futures[i].get();
+                    cache[newPoints[i]] = ratio;
                     
-                    double spacing = 0.0;
-                    if (idx > 0 && idx < points.size()) {
-                        spacing = points[idx].first - points[idx - 1].first;
+                    double diff = abs(ratio - targetPercentage);
+                    if (diff < bestDiff) {
+                        bestDiff = diff;
+                        bestThreshold = newPoints[i];
                     }
                     
-                    if (spacing < minSpacing) {
-                        minSpacing = spacing;
-                        minSpacingIdx = i;
-                    }
+                    /*
+                    cout << "Iteration " << iteration << ", threshold = " << newPoints[i] 
+                         << ", compression = " << ratio << ", diff = " << diff << endl;
+                    */
                 }
                 
-                newPoints.erase(newPoints.begin() + minSpacingIdx);
+                continue;
+            }
+            
+            // Update search range (iteration)
+            lowT = leftT;
+            highT = rightT;
+            
+            // Generate test points within the current interval
+            vector<double> testPoints;
+            
+            double midT = (lowT + highT) / 2.0;
+            if (cache.find(midT) == cache.end()) {
+                testPoints.push_back(midT);
+            }
+            
+            // Add quarter points if interval is large enough
+            double range = highT - lowT;
+            if (range > (initialPoints.back() - initialPoints.front()) / 100.0) {
+                double quarterT = lowT + range / 4.0;
+                double threeQuarterT = lowT + 3.0 * range / 4.0;
+                
+                if (cache.find(quarterT) == cache.end()) {
+                    testPoints.push_back(quarterT);
+                }
+                
+                if (cache.find(threeQuarterT) == cache.end()) {
+                    testPoints.push_back(threeQuarterT);
+                }
             }
             
-            if (newPoints.empty()) {
+            if (testPoints.empty()) {
                 break;
             }
             
-            // Evaluate new points in parallel
+            // Evaluate test points in parallel
             vector<future<double>> futures;
-            for (double point : newPoints) {
-                futures.push_back(async(launch::async, getCompressionRatio, point));
+            for (double point : testPoints) {
+                futures.push_back(async(launch::async, estimateCompressionRatio, point));
             }
             
             // Collect results
-            for (size_t i = 0; i < newPoints.size(); i++) {
+            for (size_t i = 0; i < testPoints.size(); i++) {
                 double ratio = futures[i].get();
-                cache[newPoints[i]] = ratio;
+                cache[testPoints[i]] = ratio;
                 
                 double diff = abs(ratio - targetPercentage);
                 if (diff < bestDiff) {
                     bestDiff = diff;
-                    bestThreshold = newPoints[i];
+                    bestThreshold = testPoints[i];
                 }
                 
                 /*
-                cout << "Iteration " << iteration << ", threshold = " << newPoints[i] 
+                cout << "Iteration " << iteration << ", threshold = " << testPoints[i] 
                      << ", compression = " << ratio << ", diff = " << diff << endl;
                 */
             }
-            
-            continue;
-        }
-        
-        // Update search range (iteration)
-        lowT = leftT;
-        highT = rightT;
-        
-        // Generate test points within the current interval
-        vector<double> testPoints;
-        
-        double midT = (lowT + highT) / 2.0;
-        if (cache.find(midT) == cache.end()) {
-            testPoints.push_back(midT);
         }
         
-        // Add quarter points if interval is large enough
-        double range = highT - lowT;
-        if (range > (initialPoints.back() - initialPoints.front()) / 100.0) {
-            double quarterT = lowT + range / 4.0;
-            double threeQuarterT = lowT + 3.0 * range / 4.0;
-            
-            if (cache.find(quarterT) == cache.end()) {
-                testPoints.push_back(quarterT);
-            }
-            
-            if (cache.find(threeQuarterT) == cache.end()) {
-                testPoints.push_back(threeQuarterT);
-            }
-        }
-        
-        if (testPoints.empty()) {
+        // final exact verification of a predicted best, the encode also refines the model
+        bool predicted = featuresByThreshold.find(bestThreshold) != featuresByThreshold.end();
+        if (!predicted || verifications++ >= maxVerifications) {
             break;
         }
-        
-        // Evaluate test points in parallel
-        vector<future<double>> futures;
-        for (double point : testPoints) {
-            futures.push_back(async(launch::async, getCompressionRatio, point));
+        cache[bestThreshold] = getCompressionRatio(bestThreshold);
+        featuresByThreshold.erase(bestThreshold);
+        for (const auto& entry : featuresByThreshold) {
+            cache[entry.first] = 1.0 - (static_cast<double>(predictor.predict(entry.second)) / originalImageSize);
         }
         
-        // Collect results
-        for (size_t i = 0; i < testPoints.size(); i++) {
-            double ratio = futures[i].get();
-            cache[testPoints[i]] = ratio;
-            
-            double diff = abs(ratio - targetPercentage);
+        bestDiff = numeric_limits<double>::max();
+        for (const auto& entry : cache) {
+            double diff = abs(entry.second - targetPercentage);
             if (diff < bestDiff) {
                 bestDiff = diff;
-                bestThreshold = testPoints[i];
+                bestThreshold = entry.first;
+            }
+        }
+        // predictions off the error tree are free, otherwise each one is still a build
+        // and the rounds share the iteration budget (at least one more each)
+        iteration = errorTree.empty() ? min(iteration, maxIterations) - 1 : 0;
+    }
+    
+    // the answer is always an encoded tree, never a prediction
+    if (featuresByThreshold.find(bestThreshold) != featuresByThreshold.end()) {
+        bestDiff = numeric_limits<double>::max();
+        for (const auto& entry : cache) {
+            double diff = abs(entry.second - targetPercentage);
+            if (featuresByThreshold.find(entry.first) == featuresByThreshold.end() && diff < bestDiff) {
+                bestDiff = diff;
+                bestThreshold = entry.first;
             }
-            
-            /*
-            cout << "Iteration " << iteration << ", threshold = " << testPoints[i] 
-                 << ", compression = " << ratio << ", diff = " << diff << endl;
-            */
         }
     }
     
+    // the loop test counts one past the budget when it runs out, verification rounds add more
     cout << "Best threshold found: " << bestThreshold 
-         << " (iteration " << iteration << "/" << maxIterations 
+         << " (iteration " << min(iteration, maxIterations) << "/" << maxIterations 
          << ", difference: " << bestDiff << ")" << endl;
     
     return bestThreshold;
@@ -574,59 +899,21 @@ double ImageProcessor::findThresholdForTargetCompression(double targetPercentage
 
 
 // calculating compressed size theoretically (helper for targetted compression - might help? hehe)
+// the tree encoded in the output format, the same bytes saveCompressedImage would write
 size_t ImageProcessor::calculateTheoricalCompressedSize(const QuadTree& tree) const {
-    if (!tree.getRoot()) {
+    size_t dot = params.outputImagePath.find_last_of('.');
+    vector<unsigned char> buffer;
+    if (tree.empty() || dot == string::npos || !encodeTree(tree, params.outputImagePath.substr(dot), buffer)) {
         return 0;
     }
     
-    // Count leaf nodes
-    int leafCount = 0;
-    
-    // Function to recursively count leaf nodes
-    function<void(shared_ptr<QuadTreeNode>)> countLeaves = [&](shared_ptr<QuadTreeNode> node) {
-        if (!node) return;
-        
-        if (node->isLeaf()) {
-            leafCount++;
-        } else {
-            for (const auto& child : node->getChildren()) {
-                countLeaves(child);
-            }
-        }
-    };
-    
-    countLeaves(tree.getRoot());
-    
-    // Each leaf node needs: (theoretically)
-    // - Position (x,y): 2 integers = 8 bytes
-    // - Size (width,height): 2 integers = 8 bytes
-    // - Color (r,g,b): 3 bytes
-    const size_t BYTES_PER_LEAF = 24;
-    
-    // Add header
-    const size_t HEADER_SIZE = 64;
-    
-    // Calculate base size
-    size_t baseSize = HEADER_SIZE + (leafCount * BYTES_PER_LEAF);
-
-    string outputFormat = params.outputImagePath.substr(params.outputImagePath.find_last_of(".") + 1);
-    
-    double formatFactor = 1.0;
-    if (outputFormat == "jpg" || outputFormat == "jpeg") {
-        formatFactor = 1.5;
-    } else if (outputFormat == "png") {
-        formatFactor = 2.0;
-    }
-    
-    double blockSizeFactor = 16.0 / params.minBlockSize;
-    
-    return static_cast<size_t>(baseSize * formatFactor * blockSizeFactor);
+    return buffer.size();
 }
 
 
 // converter from compressed to image format
 bool ImageProcessor::saveCompressedImage(const string& outputPath) {
-    if (!quadTree.getRoot()) {
+    if (quadTree.empty()) {
         cerr << "No quadtree to save" << endl;
         return false;
     }
@@ -639,33 +926,23 @@ bool ImageProcessor::saveCompressedImage(const string& outputPath) {
             cout << "Saving compressed image to: " << outputPath << endl;
         }
         
-        // Buat gambar baru dengan dimensi yang sama
-        cv::Mat outputImage(imageHeight, imageWidth, CV_8UC3, cv::Scalar(0, 0, 0));
-        
-        // Fungsi rekursif untuk merender QuadTree ke gambar
-        function<void(shared_ptr<QuadTreeNode>)> renderNode = [&](shared_ptr<QuadTreeNode> node) {
-            if (!node) return;
+        // indexed png from the leaf colors, no BGR render needed
+        if (params.palettePng && outputPath.find(".png") != string::npos) {
+            size_t bytes = 0, colors = 0;
+            bool exact = true;
+            if (!PalettePngWriter::writeFile(outputPath, quadTree, getBuildPool(), bytes, colors, exact)) {
+                return false;
+            }
+            compressedImageSize = bytes;
             
-            if (node->isLeaf()) {
-                // Gambar blok dengan warna rata-rata
-                Pixel color = node->getColor();
-                cv::Scalar pixelColor(color.b, color.g, color.r);
-                int x = max(0, node->getX());
-                int y = max(0, node->getY());
-                int width = min(node->getWidth(), imageWidth - x);
-                int height = min(node->getHeight(), imageHeight - y);
-                if (width > 0 && height > 0) {
-                    cv::rectangle(outputImage, cv::Point(x, y), cv::Point(x + width, y + height), pixelColor, -1);
-                }
-            } else {
-                for (const auto& child : node->getChildren()) {
-                    renderNode(child);
-                }
+            if (!isTemp) {
+                cout << "Image saved successfully (" << colors << " color palette" << (exact ? "" : ", quantized") << ")" << endl;
             }
-        };
+            return true;
+        }
         
-        // Render QuadTree ke dalam outputImage
-        renderNode(quadTree.getRoot());
+        // Render QuadTree (shared with the buffer and GIF outputs)
+        const cv::Mat& outputImage = getRenderedImage();
         
         // Tentukan parameter kompresi berdasarkan ekstensi file
         vector<int> compression_params;
@@ -706,62 +983,109 @@ bool ImageProcessor::saveCompressedImage(const string& outputPath) {
 }
 
 
+// native quadtree stream, the tree itself instead of its rendering
+bool ImageProcessor::saveQuadTreeStream(const string& outputPath) {
+    if (quadTree.empty()) {
+        cerr << "No quadtree to save" << endl;
+        return false;
+    }
+    
+    cout << "Saving quadtree stream to: " << outputPath << endl;
+    size_t bytes = 0;
+    QuadTreeCodec::Layout layout = QuadTreeCodec::Layout::PRE_ORDER;
+    if (params.progressiveStream) {
+        layout = QuadTreeCodec::Layout::BREADTH_FIRST;
+    } else if (params.streamIndexLevels > 0) {
+        layout = QuadTreeCodec::Layout::INDEXED;
+    }
+    if (!QuadTreeCodec::writeFile(outputPath, quadTree, bytes, layout, params.streamIndexLevels)) {
+        return false;
+    }
+    cout << "Quadtree stream saved: " << bytes << " bytes ("
+         << fixed << setprecision(2) << static_cast<double>(bytes) / quadTree.getLeafCount() << " bytes per leaf)" << endl;
+    return true;
+}
+
+
 // converter from compressed to buffer (helper for targetted compress)
 bool ImageProcessor::saveCompressedImageToBuffer(const string& extension, vector<unsigned char>& buffer) {
-    if (!quadTree.getRoot()) {
+    if (quadTree.empty()) {
         cerr << "No quadtree to save" << endl;
         return false;
     }
     
     try {
-        cv::Mat outputImage(imageHeight, imageWidth, CV_8UC3, cv::Scalar(0, 0, 0));
-        
-        // render quadtree to image
-        function<void(shared_ptr<QuadTreeNode>)> renderNode = [&](shared_ptr<QuadTreeNode> node) {
-            if (!node) return;
-            if (node->isLeaf()) {
-                Pixel color = node->getColor();
-                cv::Scalar pixelColor(color.b, color.g, color.r);
-                int x = max(0, node->getX());
-                int y = max(0, node->getY());
-                int width = min(node->getWidth(), imageWidth - x);
-                int height = min(node->getHeight(), imageHeight - y);
-                if (width > 0 && height > 0) {
-                    cv::rectangle(outputImage, cv::Point(x, y), cv::Point(x + width, y + height), pixelColor, -1);
-                }
-            } else {
-                for (const auto& child : node->getChildren())
-                    renderNode(child);
+        size_t colors = 0;
+        bool exact = true;
+        if (params.palettePng && extension == ".png") {
+            if (!PalettePngWriter::encode(quadTree, buffer, getBuildPool(), colors, exact)) {
+                return false;
             }
-        };
-        
-        renderNode(quadTree.getRoot());
-        
-        // extension
-        vector<int> compression_params;
-        if (extension == ".jpg" || extension == ".jpeg") {
-            compression_params.push_back(cv::IMWRITE_JPEG_QUALITY);
-            compression_params.push_back(85);
-        } else if (extension == ".png") {
-            compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
-            compression_params.push_back(9);
-        }
-        
-        bool success = cv::imencode(extension, outputImage, buffer, compression_params);
-        if (!success) {
-            cerr << "Failed to encode image to memory buffer" << endl;
+        } else if (!encodeImage(getRenderedImage(), extension, buffer)) {
             return false;
         }
+    } catch (const exception& e) {
+        cerr << "Exception in saveCompressedImageToBuffer: " << e.what() << endl;
+        return false;
+    }
+    
+    // Update file size
+    compressedImageSize = buffer.size();
+    return true;
+}
+
+// output image of the current tree, only re-rendered after the tree changed
+const cv::Mat& ImageProcessor::getRenderedImage() {
+    uint64_t version = quadTree.getVersion();
+    if (renderedVersion != version || renderedImage.empty()) {
+        // the leaves cover every pixel, no clear needed
+        renderedImage.create(imageHeight, imageWidth, CV_8UC3);
+        LeafRasterizer::render(quadTree, renderedImage.ptr<unsigned char>(0), imageWidth, imageHeight, static_cast<size_t>(renderedImage.step), getBuildPool());
+        renderedVersion = version;
+    }
+    return renderedImage;
+}
+
+// render and encode any tree, no member is touched (safe for concurrent probes)
+bool ImageProcessor::encodeTree(const QuadTree& tree, const string& extension, vector<unsigned char>& buffer) const {
+    try {
+        if (params.palettePng && extension == ".png") {
+            size_t colors = 0;
+            bool exact = true;
+            return PalettePngWriter::encode(tree, buffer, buildPool.get(), colors, exact);
+        }
         
-        // Update file size
-        compressedImageSize = buffer.size();
-        return true;
+        cv::Mat outputImage(imageHeight, imageWidth, CV_8UC3);
+        
+        // render quadtree to image (pool is shared with concurrent probes, never created here)
+        LeafRasterizer::render(tree, outputImage.ptr<unsigned char>(0), imageWidth, imageHeight, static_cast<size_t>(outputImage.step), buildPool.get());
+        return encodeImage(outputImage, extension, buffer);
         
     } catch (const exception& e) {
-        cerr << "Exception in saveCompressedImageToBuffer: " << e.what() << endl;
+        cerr << "Exception in encodeTree: " << e.what() << endl;
         return false;
     } catch (...) {
-        cerr << "Unknown exception in saveCompressedImageToBuffer" << endl;
+        cerr << "Unknown exception in encodeTree" << endl;
+        return false;
+    }
+}
+
+// in-memory encode with the same settings as saveCompressedImage
+bool ImageProcessor::encodeImage(const cv::Mat& image, const string& extension, vector<unsigned char>& buffer) {
+    // extension
+    vector<int> compression_params;
+    if (extension == ".jpg" || extension == ".jpeg") {
+        compression_params.push_back(cv::IMWRITE_JPEG_QUALITY);
+        compression_params.push_back(85);
+    } else if (extension == ".png") {
+        compression_params.push_back(cv::IMWRITE_PNG_COMPRESSION);
+        compression_params.push_back(9);
+    }
+    
+    bool success = cv::imencode(extension, image, buffer, compression_params);
+    if (!success) {
+        cerr << "Failed to encode image to memory buffer" << endl;
         return false;
     }
+    return true;
 }
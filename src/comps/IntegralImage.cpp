@@ -0,0 +1,79 @@
+// include header file
+#include "IntegralImage.hpp"
+
+
+IntegralImage::IntegralImage(): width(0), height(0) {
+    // cons
+}
+
+// table builder
+void IntegralImage::build(const ImageView& image) {
+    width = image.getWidth();
+    height = image.getHeight();
+    entries.assign(static_cast<size_t>(width + 1) * (height + 1), Entry{});
+    
+    for (int y = 0; y < height; ++y) {
+        // running sums of the current row
+        uint64_t rowSum[3] = {0, 0, 0};
+        uint64_t rowSumSq[3] = {0, 0, 0};
+        
+        const Pixel* row = image.row(y);
+        const Entry* above = &entries[index(1, y)];
+        Entry* current = &entries[index(1, y + 1)];
+        
+        for (int x = 0; x < width; ++x) {
+            const Pixel& p = row[x];
+            const unsigned values[3] = {p.r, p.g, p.b};
+            
+            for (int c = 0; c < 3; ++c) {
+                rowSum[c] += values[c];
+                rowSumSq[c] += values[c] * values[c];
+                current[x].sum[c] = above[x].sum[c] + rowSum[c];
+                current[x].sumSq[c] = above[x].sumSq[c] + rowSumSq[c];
+            }
+        }
+    }
+}
+
+void IntegralImage::clear() {
+    width = 0;
+    height = 0;
+    entries.clear();
+    entries.shrink_to_fit();
+}
+
+// region checker
+bool IntegralImage::covers(int x, int y, int w, int h) const {
+    return isBuilt() && x >= 0 && y >= 0 && w > 0 && h > 0 && x + w <= width && y + h <= height;
+}
+
+// sum of a channel inside region
+uint64_t IntegralImage::getSum(int x, int y, int w, int h, int channel) const {
+    return entries[index(x + w, y + h)].sum[channel] - entries[index(x, y + h)].sum[channel]
+         - entries[index(x + w, y)].sum[channel] + entries[index(x, y)].sum[channel];
+}
+
+// sum of squared channel values inside region
+uint64_t IntegralImage::getSumOfSquares(int x, int y, int w, int h, int channel) const {
+    return entries[index(x + w, y + h)].sumSq[channel] - entries[index(x, y + h)].sumSq[channel]
+         - entries[index(x + w, y)].sumSq[channel] + entries[index(x, y)].sumSq[channel];
+}
+
+// all channel moments of a region, four corner reads
+void IntegralImage::getMoments(int x, int y, int w, int h, ChannelMoments& out) const {
+    const Entry& a = entries[index(x + w, y + h)];
+    const Entry& b = entries[index(x, y + h)];
+    const Entry& c = entries[index(x + w, y)];
+    const Entry& d = entries[index(x, y)];
+    
+    out.count = static_cast<uint64_t>(w) * h;
+    for (int ch = 0; ch < 3; ++ch) {
+        out.sum[ch] = a.sum[ch] - b.sum[ch] - c.sum[ch] + d.sum[ch];
+        out.sumSq[ch] = a.sumSq[ch] - b.sumSq[ch] - c.sumSq[ch] + d.sumSq[ch];
+    }
+}
+
+// population variance (same formula as the fused kernels)
+double IntegralImage::getVariance(int x, int y, int w, int h, int channel) const {
+    return ErrorKernels::variance(static_cast<uint64_t>(w) * h, getSum(x, y, w, h, channel), getSumOfSquares(x, y, w, h, channel));
+}
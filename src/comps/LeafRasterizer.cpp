@@ -0,0 +1,185 @@
+// include header file
+#include "LeafRasterizer.hpp"
+
+// include lib files
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+
+// bands per thread, smaller bands balance uneven leaf density
+static const int BANDS_PER_THREAD = 4;
+static const int MIN_BAND_ROWS = 32;
+
+// spans up to this many pixels skip the pattern copy
+static const int NARROW_SPAN = 16;
+
+
+// leaf rectangle clipped like the cv::rectangle call it replaces (image of width x height),
+// then to the viewport, in viewport coordinates; false when empty
+inline bool LeafRasterizer::clipLeaf(const QuadTreeNode& node, int width, int height, const Viewport& view, Span& span) {
+    int x0 = max(0, node.getX());
+    int y0 = max(0, node.getY());
+    int w = min(node.getWidth(), width - x0);
+    int h = min(node.getHeight(), height - y0);
+    if (w <= 0 || h <= 0) {
+        return false;
+    }
+    int x1 = min(x0 + w, width - 1);
+    int y1 = min(y0 + h, height - 1);
+    
+    span.x0 = max(x0, view.x) - view.x;
+    span.y0 = max(y0, view.y) - view.y;
+    span.x1 = min(x1, view.x + view.width - 1) - view.x;
+    span.y1 = min(y1, view.y + view.height - 1) - view.y;
+    span.color = node.getColor();
+    return span.x0 <= span.x1 && span.y0 <= span.y1;
+}
+
+// leaf rectangles in depth-first order
+void LeafRasterizer::collect(const QuadTree& tree, const Viewport& view, vector<Span>& spans) {
+    spans.clear();
+    spans.reserve(tree.getLeafCount());
+    tree.forEachLeaf([&](const QuadTreeNode& node) {
+        Span span;
+        if (clipLeaf(node, tree.getWidth(), tree.getHeight(), view, span)) {
+            spans.push_back(span);
+        }
+    });
+}
+
+// narrow spans are written pixel by pixel, wide ones get their first row from a
+// 16-pixel pattern in 48-byte copies and the other rows copied from the first
+void LeafRasterizer::renderSpan(const Span& span, unsigned char* bgr, size_t stride, int firstRow, int lastRow) {
+    int top = max(span.y0, firstRow);
+    int bottom = min(span.y1, lastRow);
+    if (top > bottom) {
+        return;
+    }
+    
+    const unsigned char b = span.color.b, g = span.color.g, r = span.color.r;
+    int count = span.x1 - span.x0 + 1;
+    if (count <= NARROW_SPAN) {
+        for (int y = top; y <= bottom; ++y) {
+            unsigned char* out = bgr + y * stride + span.x0 * 3;
+            for (int i = 0; i < count; ++i, out += 3) {
+                out[0] = b;
+                out[1] = g;
+                out[2] = r;
+            }
+        }
+        return;
+    }
+    
+    unsigned char pattern[48];
+    for (int i = 0; i < 16; ++i) {
+        pattern[i * 3] = b;
+        pattern[i * 3 + 1] = g;
+        pattern[i * 3 + 2] = r;
+    }
+    
+    size_t bytes = static_cast<size_t>(count) * 3;
+    unsigned char* first = bgr + top * stride + span.x0 * 3;
+    unsigned char* out = first;
+    size_t left = bytes;
+    while (left >= sizeof(pattern)) {
+        memcpy(out, pattern, sizeof(pattern));
+        out += sizeof(pattern);
+        left -= sizeof(pattern);
+    }
+    memcpy(out, pattern, left);
+    
+    for (int y = top + 1; y <= bottom; ++y) {
+        memcpy(bgr + y * stride + span.x0 * 3, first, bytes);
+    }
+}
+
+// one palette index per pixel, rows are plain byte runs
+void LeafRasterizer::renderIndexSpan(const Span& span, unsigned char index, unsigned char* indices, size_t stride, int firstRow, int lastRow) {
+    int top = max(span.y0, firstRow);
+    int bottom = min(span.y1, lastRow);
+    size_t count = static_cast<size_t>(span.x1 - span.x0 + 1);
+    for (int y = top; y <= bottom; ++y) {
+        memset(indices + y * stride + span.x0, index, count);
+    }
+}
+
+// clipped leaves handed to paint(span, firstRow, lastRow) in depth-first order, each
+// band of the viewport on its own task when there is a pool
+template <typename Paint>
+void LeafRasterizer::paintBands(const QuadTree& tree, const Viewport& view, WorkStealingPool* pool, const Paint& paint) {
+    int height = view.height;
+    int bands = pool ? static_cast<int>(pool->getThreadCount()) * BANDS_PER_THREAD : 1;
+    bands = max(1, min(bands, height / MIN_BAND_ROWS));
+    if (bands == 1) {
+        // straight from the traversal, no leaf list
+        tree.forEachLeaf([&](const QuadTreeNode& node) {
+            Span span;
+            if (clipLeaf(node, tree.getWidth(), tree.getHeight(), view, span)) {
+                paint(span, 0, height - 1);
+            }
+        });
+        return;
+    }
+    
+    vector<Span> spans;
+    collect(tree, view, spans);
+    
+    // bucket the spans per band (counting sort, depth-first order kept inside a band)
+    int rowsPerBand = (height + bands - 1) / bands;
+    bands = (height + rowsPerBand - 1) / rowsPerBand;
+    vector<uint32_t> bandStart(bands + 1, 0);
+    for (const Span& span : spans) {
+        for (int band = span.y0 / rowsPerBand; band <= span.y1 / rowsPerBand; ++band) {
+            bandStart[band + 1]++;
+        }
+    }
+    for (int band = 0; band < bands; ++band) {
+        bandStart[band + 1] += bandStart[band];
+    }
+    vector<uint32_t> bandSpans(bandStart[bands]);
+    vector<uint32_t> fill(bandStart.begin(), bandStart.end() - 1);
+    for (uint32_t i = 0; i < spans.size(); ++i) {
+        for (int band = spans[i].y0 / rowsPerBand; band <= spans[i].y1 / rowsPerBand; ++band) {
+            bandSpans[fill[band]++] = i;
+        }
+    }
+    
+    WorkStealingPool::TaskGroup group;
+    for (int band = 0; band < bands; ++band) {
+        pool->spawn(group, [&spans, &bandStart, &bandSpans, &paint, band, rowsPerBand, height] {
+            int firstRow = band * rowsPerBand;
+            int lastRow = min(firstRow + rowsPerBand, height) - 1;
+            for (uint32_t i = bandStart[band]; i < bandStart[band + 1]; ++i) {
+                paint(spans[bandSpans[i]], firstRow, lastRow);
+            }
+        });
+    }
+    pool->wait(group);
+}
+
+void LeafRasterizer::render(const QuadTree& tree, unsigned char* bgr, int width, int height, size_t stride, WorkStealingPool* pool) {
+    renderRegion(tree, 0, 0, width, height, bgr, stride, pool);
+}
+
+void LeafRasterizer::renderRegion(const QuadTree& tree, int x, int y, int width, int height, unsigned char* bgr, size_t stride, WorkStealingPool* pool) {
+    if (tree.empty() || width <= 0 || height <= 0) {
+        return;
+    }
+    
+    Viewport view = {x, y, width, height};
+    paintBands(tree, view, pool, [bgr, stride](const Span& span, int firstRow, int lastRow) {
+        renderSpan(span, bgr, stride, firstRow, lastRow);
+    });
+}
+
+void LeafRasterizer::renderIndexed(const QuadTree& tree, const function<unsigned char(const Pixel&)>& indexOf, unsigned char* indices, int width, int height, size_t stride, WorkStealingPool* pool) {
+    if (tree.empty() || width <= 0 || height <= 0) {
+        return;
+    }
+    
+    Viewport view = {0, 0, width, height};
+    paintBands(tree, view, pool, [&indexOf, indices, stride](const Span& span, int firstRow, int lastRow) {
+        renderIndexSpan(span, indexOf(span.color), indices, stride, firstRow, lastRow);
+    });
+}
@@ -0,0 +1,65 @@
+// include header file
+#include "MinMaxPyramid.hpp"
+
+
+// finest level keeps at least this many pixels per cell on average, so the
+// whole pyramid stays well below the image size
+static const uint64_t MIN_PIXELS_PER_CELL = 8;
+
+
+// pyramid builder
+void MinMaxPyramid::build(const ImageView& image) {
+    int finest = QuadGrid::finestLevelFor(image.getWidth(), image.getHeight(), MIN_PIXELS_PER_CELL);
+    grid.build(image.getWidth(), image.getHeight(), finest + 1);
+    cells.assign(finest + 1, vector<ChannelRange>());
+    
+    // finest level from the pixels, empty intervals stay neutral
+    ChannelRange neutral;
+    for (int c = 0; c < 3; ++c) {
+        neutral.minValue[c] = 255;
+        neutral.maxValue[c] = 0;
+    }
+    
+    size_t side = grid.getSide(finest);
+    cells[finest].assign(side * side, neutral);
+    for (size_t cy = 0; cy < side; ++cy) {
+        if (grid.getHeight(finest, cy) == 0) continue;
+        for (size_t cx = 0; cx < side; ++cx) {
+            if (grid.getWidth(finest, cx) == 0) continue;
+            ErrorKernels::blockRange(image, grid.getX(finest, cx), grid.getY(finest, cy),
+                                     grid.getWidth(finest, cx), grid.getHeight(finest, cy), cells[finest][cy * side + cx]);
+        }
+    }
+    
+    // coarser levels merge their 2x2 children
+    for (int d = finest - 1; d >= 0; --d) {
+        cells[d].assign(grid.getCellCount(d), neutral);
+        for (size_t i = 0; i < cells[d].size(); ++i) {
+            ChannelRange& cell = cells[d][i];
+            for (int k = 0; k < 4; ++k) {
+                const ChannelRange& child = cells[d + 1][grid.childCell(d, i, k)];
+                for (int c = 0; c < 3; ++c) {
+                    cell.minValue[c] = min(cell.minValue[c], child.minValue[c]);
+                    cell.maxValue[c] = max(cell.maxValue[c], child.maxValue[c]);
+                }
+            }
+        }
+    }
+}
+
+void MinMaxPyramid::clear() {
+    grid.clear();
+    cells.clear();
+    cells.shrink_to_fit();
+}
+
+// O(1) block lookup
+bool MinMaxPyramid::query(int x, int y, int width, int height, ChannelRange& out) const {
+    int level;
+    size_t cell;
+    if (!grid.locate(x, y, width, height, level, cell)) {
+        return false;
+    }
+    out = cells[level][cell];
+    return true;
+}
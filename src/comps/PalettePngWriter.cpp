@@ -0,0 +1,262 @@
+// include header file
+#include "PalettePngWriter.hpp"
+#include "LeafRasterizer.hpp"
+
+// include lib files
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <zlib.h>
+
+
+const size_t PalettePngWriter::MAX_COLORS;
+
+static const unsigned char PNG_SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+static const unsigned char COLOR_TYPE_PALETTE = 3;
+
+// IDAT chunks are cut at this size
+static const size_t IDAT_CHUNK = 1 << 20;
+
+// level 6 is close to 9 on palette rows, which are mostly long runs, at a fraction of the time
+static const int DEFLATE_LEVEL = 6;
+
+
+static void writeUint32(uint32_t value, vector<unsigned char>& out) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static uint32_t packColor(const Pixel& color) {
+    return (static_cast<uint32_t>(color.r) << 16) | (static_cast<uint32_t>(color.g) << 8) | color.b;
+}
+
+
+// distinct leaf colors with the area they cover, sorted by key
+void PalettePngWriter::collectColors(const QuadTree& tree, vector<ColorWeight>& colors) {
+    unordered_map<uint32_t, uint64_t> weights;
+    tree.forEachLeaf([&](const QuadTreeNode& node) {
+        weights[packColor(node.getColor())] += static_cast<uint64_t>(node.getWidth()) * node.getHeight();
+    });
+    
+    colors.clear();
+    colors.reserve(weights.size());
+    for (const auto& entry : weights) {
+        colors.push_back({entry.first, entry.second});
+    }
+    sort(colors.begin(), colors.end(), [](const ColorWeight& a, const ColorWeight& b) { return a.key < b.key; });
+}
+
+void PalettePngWriter::measureBox(const vector<ColorWeight>& colors, Box& box) {
+    int low[3] = {255, 255, 255};
+    int high[3] = {0, 0, 0};
+    for (size_t i = box.begin; i < box.end; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            int value = (colors[i].key >> (16 - c * 8)) & 0xFF;
+            low[c] = min(low[c], value);
+            high[c] = max(high[c], value);
+        }
+    }
+    
+    box.channel = 16;
+    box.range = 0;
+    for (int c = 0; c < 3; ++c) {
+        if (high[c] - low[c] > box.range) {
+            box.range = high[c] - low[c];
+            box.channel = 16 - c * 8;
+        }
+    }
+}
+
+Pixel PalettePngWriter::meanColor(const vector<ColorWeight>& colors, const Box& box) {
+    uint64_t sum[3] = {0, 0, 0};
+    uint64_t weight = 0;
+    for (size_t i = box.begin; i < box.end; ++i) {
+        sum[0] += colors[i].weight * ((colors[i].key >> 16) & 0xFF);
+        sum[1] += colors[i].weight * ((colors[i].key >> 8) & 0xFF);
+        sum[2] += colors[i].weight * (colors[i].key & 0xFF);
+        weight += colors[i].weight;
+    }
+    return Pixel(static_cast<unsigned char>((sum[0] + weight / 2) / weight),
+                 static_cast<unsigned char>((sum[1] + weight / 2) / weight),
+                 static_cast<unsigned char>((sum[2] + weight / 2) / weight));
+}
+
+// exact palette for few colors, else median cut: the box with the widest channel is split
+// at its area-weighted median until there are MAX_COLORS boxes, each color maps to its box
+void PalettePngWriter::buildPalette(vector<ColorWeight>& colors, vector<Pixel>& palette, unordered_map<uint32_t, unsigned char>& indexOf) {
+    palette.clear();
+    indexOf.clear();
+    indexOf.reserve(colors.size());
+    if (colors.size() <= MAX_COLORS) {
+        for (size_t i = 0; i < colors.size(); ++i) {
+            uint32_t key = colors[i].key;
+            palette.push_back(Pixel((key >> 16) & 0xFF, (key >> 8) & 0xFF, key & 0xFF));
+            indexOf[key] = static_cast<unsigned char>(i);
+        }
+        return;
+    }
+    
+    vector<Box> boxes(1);
+    boxes[0].begin = 0;
+    boxes[0].end = colors.size();
+    measureBox(colors, boxes[0]);
+    while (boxes.size() < MAX_COLORS) {
+        size_t widest = 0;
+        for (size_t i = 1; i < boxes.size(); ++i) {
+            if (boxes[i].range > boxes[widest].range) {
+                widest = i;
+            }
+        }
+        Box box = boxes[widest];
+        if (box.range == 0) {
+            break;
+        }
+        
+        int shift = box.channel;
+        sort(colors.begin() + box.begin, colors.begin() + box.end, [shift](const ColorWeight& a, const ColorWeight& b) {
+            return ((a.key >> shift) & 0xFF) < ((b.key >> shift) & 0xFF);
+        });
+        uint64_t total = 0;
+        for (size_t i = box.begin; i < box.end; ++i) {
+            total += colors[i].weight;
+        }
+        // both halves keep at least one color (the range is not 0, so there are two)
+        size_t split = box.begin + 1;
+        uint64_t below = colors[box.begin].weight;
+        while (split < box.end - 1 && below * 2 < total) {
+            below += colors[split++].weight;
+        }
+        
+        Box upper = {split, box.end, 16, 0};
+        box.end = split;
+        measureBox(colors, box);
+        measureBox(colors, upper);
+        boxes[widest] = box;
+        boxes.push_back(upper);
+    }
+    
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        palette.push_back(meanColor(colors, boxes[i]));
+        for (size_t j = boxes[i].begin; j < boxes[i].end; ++j) {
+            indexOf[colors[j].key] = static_cast<unsigned char>(i);
+        }
+    }
+}
+
+// fewest bits per index PNG allows for the palette
+int PalettePngWriter::bitDepth(size_t colors) {
+    if (colors <= 2) {
+        return 1;
+    }
+    if (colors <= 4) {
+        return 2;
+    }
+    return colors <= 16 ? 4 : 8;
+}
+
+// rows of width + 1 bytes (filter byte, one index per pixel) packed in place to depth bits per pixel
+void PalettePngWriter::packRows(vector<unsigned char>& rows, int width, int height, int depth) {
+    size_t rowBytes = (static_cast<size_t>(width) * depth + 7) / 8;
+    int perByte = 8 / depth;
+    for (int y = 0; y < height; ++y) {
+        const unsigned char* in = rows.data() + static_cast<size_t>(y) * (width + 1) + 1;
+        unsigned char* out = rows.data() + static_cast<size_t>(y) * (rowBytes + 1);
+        out[0] = 0;
+        for (size_t i = 0; i < rowBytes; ++i) {
+            unsigned char packed = 0;
+            for (int k = 0; k < perByte; ++k) {
+                size_t x = i * perByte + k;
+                unsigned char index = x < static_cast<size_t>(width) ? in[x] : 0;
+                packed |= static_cast<unsigned char>(index << (8 - depth * (k + 1)));
+            }
+            out[1 + i] = packed;
+        }
+    }
+    rows.resize(static_cast<size_t>(height) * (rowBytes + 1));
+}
+
+void PalettePngWriter::writeChunk(const char* type, const unsigned char* data, size_t size, vector<unsigned char>& out) {
+    writeUint32(static_cast<uint32_t>(size), out);
+    size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    writeUint32(static_cast<uint32_t>(crc32(0, out.data() + start, static_cast<uInt>(size + 4))), out);
+}
+
+
+bool PalettePngWriter::encode(const QuadTree& tree, vector<unsigned char>& out, WorkStealingPool* pool, size_t& colors, bool& exact) {
+    if (tree.empty()) {
+        cerr << "No quadtree to encode" << endl;
+        return false;
+    }
+    
+    vector<ColorWeight> weights;
+    collectColors(tree, weights);
+    exact = weights.size() <= MAX_COLORS;
+    vector<Pixel> palette;
+    unordered_map<uint32_t, unsigned char> indexOf;
+    buildPalette(weights, palette, indexOf);
+    colors = palette.size();
+    
+    // indices rendered behind a filter byte per row (filter none, rows of runs gain nothing from the others)
+    int width = tree.getWidth();
+    int height = tree.getHeight();
+    vector<unsigned char> rows(static_cast<size_t>(height) * (width + 1), 0);
+    LeafRasterizer::renderIndexed(tree, [&indexOf](const Pixel& color) { return indexOf.find(packColor(color))->second; },
+                                  rows.data() + 1, width, height, static_cast<size_t>(width) + 1, pool);
+    int depth = bitDepth(palette.size());
+    if (depth < 8) {
+        packRows(rows, width, height, depth);
+    }
+    
+    uLongf compressedSize = compressBound(static_cast<uLong>(rows.size()));
+    vector<unsigned char> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, rows.data(), static_cast<uLong>(rows.size()), DEFLATE_LEVEL) != Z_OK) {
+        cerr << "Failed to deflate palette image" << endl;
+        return false;
+    }
+    
+    out.clear();
+    out.insert(out.end(), PNG_SIGNATURE, PNG_SIGNATURE + sizeof(PNG_SIGNATURE));
+    
+    vector<unsigned char> header;
+    writeUint32(static_cast<uint32_t>(width), header);
+    writeUint32(static_cast<uint32_t>(height), header);
+    header.push_back(static_cast<unsigned char>(depth));
+    header.push_back(COLOR_TYPE_PALETTE);
+    header.push_back(0); // deflate
+    header.push_back(0); // adaptive filtering
+    header.push_back(0); // no interlace
+    writeChunk("IHDR", header.data(), header.size(), out);
+    
+    vector<unsigned char> entries;
+    for (const Pixel& color : palette) {
+        entries.push_back(color.r);
+        entries.push_back(color.g);
+        entries.push_back(color.b);
+    }
+    writeChunk("PLTE", entries.data(), entries.size(), out);
+    
+    for (size_t offset = 0; offset < compressedSize; offset += IDAT_CHUNK) {
+        writeChunk("IDAT", compressed.data() + offset, min<size_t>(IDAT_CHUNK, compressedSize - offset), out);
+    }
+    writeChunk("IEND", nullptr, 0, out);
+    return true;
+}
+
+bool PalettePngWriter::writeFile(const string& path, const QuadTree& tree, WorkStealingPool* pool, size_t& bytesWritten, size_t& colors, bool& exact) {
+    vector<unsigned char> buffer;
+    if (!encode(tree, buffer, pool, colors, exact)) {
+        return false;
+    }
+    
+    ofstream file(path, ios::binary);
+    if (!file || !file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size())) {
+        cerr << "Failed to write palette image: " << path << endl;
+        return false;
+    }
+    bytesWritten = buffer.size();
+    return true;
+}
@@ -0,0 +1,117 @@
+// include header file
+#include "QuadGrid.hpp"
+
+
+QuadGrid::QuadGrid(): width(0), height(0) {
+    // cons
+}
+
+// child level of one axis, same half/remainder split as buildQuadTree
+void QuadGrid::splitAxis(const AxisLevel& parent, AxisLevel& child, int extent) {
+    size_t count = parent.start.size() * 2;
+    child.start.resize(count);
+    child.length.resize(count);
+    
+    for (size_t i = 0; i < parent.start.size(); ++i) {
+        int half = parent.length[i] / 2;
+        child.start[2 * i] = parent.start[i];
+        child.length[2 * i] = half;
+        child.start[2 * i + 1] = parent.start[i] + half;
+        child.length[2 * i + 1] = parent.length[i] - half;
+    }
+    
+    child.indexAt.assign(extent, -1);
+    for (size_t i = 0; i < count; ++i) {
+        if (child.length[i] > 0) {
+            child.indexAt[child.start[i]] = static_cast<int32_t>(i);
+        }
+    }
+}
+
+// axis partitions, top to bottom
+void QuadGrid::build(int imageWidth, int imageHeight, int levelCount) {
+    width = imageWidth;
+    height = imageHeight;
+    levels.clear();
+    if (width <= 0 || height <= 0 || levelCount <= 0) {
+        return;
+    }
+    
+    levels.resize(levelCount);
+    Level& root = levels[0];
+    root.xAxis.start = {0};
+    root.xAxis.length = {width};
+    root.xAxis.indexAt.assign(width, -1);
+    root.xAxis.indexAt[0] = 0;
+    root.yAxis.start = {0};
+    root.yAxis.length = {height};
+    root.yAxis.indexAt.assign(height, -1);
+    root.yAxis.indexAt[0] = 0;
+    for (int d = 1; d < levelCount; ++d) {
+        splitAxis(levels[d - 1].xAxis, levels[d].xAxis, width);
+        splitAxis(levels[d - 1].yAxis, levels[d].yAxis, height);
+    }
+}
+
+void QuadGrid::clear() {
+    width = 0;
+    height = 0;
+    levels.clear();
+    levels.shrink_to_fit();
+}
+
+int QuadGrid::finestLevelFor(int width, int height, uint64_t minPixelsPerCell) {
+    uint64_t pixelCount = static_cast<uint64_t>(width) * height;
+    int finest = 0;
+    while (finest < 30 && (1ull << (2 * (finest + 1))) * minPixelsPerCell <= pixelCount) {
+        finest++;
+    }
+    return finest;
+}
+
+// quadrant order matches buildQuadTree (tl, tr, bl, br)
+size_t QuadGrid::childCell(int level, size_t cell, int quadrant) const {
+    size_t side = getSide(level);
+    size_t cx = cell % side, cy = cell / side;
+    return (2 * cy + quadrant / 2) * (2 * side) + 2 * cx + quadrant % 2;
+}
+
+// block -> cell at one level
+bool QuadGrid::findCell(int level, int x, int y, int w, int h, size_t& cell) const {
+    if (level < 0 || level >= static_cast<int>(levels.size())) {
+        return false;
+    }
+    
+    const Level& l = levels[level];
+    int32_t ix = l.xAxis.indexAt[x];
+    int32_t iy = l.yAxis.indexAt[y];
+    if (ix < 0 || iy < 0 || l.xAxis.length[ix] != w || l.yAxis.length[iy] != h) {
+        return false;
+    }
+    
+    cell = static_cast<size_t>(iy) * l.xAxis.start.size() + ix;
+    return true;
+}
+
+bool QuadGrid::locate(int x, int y, int w, int h, int& level, size_t& cell) const {
+    if (!isBuilt() || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > width || y + h > height) {
+        return false;
+    }
+    
+    // intervals at depth d are floor or ceil of side / 2^d, so the block sits on d or d + 1;
+    // the longer side is used, a short one stops halving long before the tree does
+    int side = width >= height ? width : height;
+    int extent = width >= height ? w : h;
+    int maxLevel = static_cast<int>(levels.size()) - 1;
+    int d = 0;
+    while (d < maxLevel && (side >> (d + 1)) >= extent) {
+        d++;
+    }
+    
+    for (level = d; level <= d + 1; ++level) {
+        if (findCell(level, x, y, w, h, cell)) {
+            return true;
+        }
+    }
+    return false;
+}
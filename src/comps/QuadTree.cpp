@@ -3,78 +3,148 @@
 
 
 // Implementation
-QuadTreeNode::QuadTreeNode(int x, int y, int width, int height): x(x), y(y), width(width), height(height), color(0, 0, 0) {
+QuadTreeNode::QuadTreeNode(int x, int y, int width, int height): x(x), y(y), width(width), height(height), color(0, 0, 0), index(0), firstChild(NO_CHILD) {
     
     // Make sure that the image has valid dimensions
     assert(width > 0 && "Width must be greater than 0");
     assert(height > 0 && "Height must be greater than 0");
 }
 
-void QuadTreeNode::addChild(shared_ptr<QuadTreeNode> child) {
+atomic<uint64_t> QuadTree::versionCounter(0);
 
-    // Child building
-    if (children.size() < 4 && child) {
-        children.push_back(child);
+QuadTree::QuadTree(): rootX(0), rootY(0), width(0), height(0), leafCount(0), version(0), modified(true) {
+    // default constructor
+}
+
+uint64_t QuadTree::getVersion() const {
+    if (modified) {
+        version = ++versionCounter;
+        modified = false;
     }
+    return version;
 }
 
-QuadTree::QuadTree(): root(nullptr), depth(0), nodeCount(0) {
-    // default constructor
+void QuadTree::reset(int imageWidth, int imageHeight) {
+    resetBlock(0, 0, imageWidth, imageHeight, 0);
 }
 
-void QuadTree::setRoot(shared_ptr<QuadTreeNode> newRoot) {
-    root = newRoot;
-    calculateDepthAndNodeCount();
+// counts stay indexed by absolute depth, so a fragment can be attached as is
+void QuadTree::resetBlock(int x, int y, int blockWidth, int blockHeight, int level) {
+    nodes.clear();
+    nodes.push_back({Pixel(0, 0, 0), static_cast<uint8_t>(PackedNode::LEAF | (level << PackedNode::LEVEL_SHIFT)), PackedNode::NO_CHILD});
+    rootX = x;
+    rootY = y;
+    width = blockWidth;
+    height = blockHeight;
+    levelCounts.assign(level + 1, 0);
+    levelCounts[level] = 1;
+    leafCount = 1;
+    modified = true;
 }
 
-void QuadTree::calculateDepthAndNodeCount() {
-    // Method to calculate the depth and node count of the QuadTree
+void QuadTree::reserve(size_t count) {
+    nodes.reserve(count);
+}
 
-    if (root) {
-        depth = calculateDepth(root);
-        nodeCount = countNodes(root);
-    } else {
-        depth = 0;
-        nodeCount = 0;
+uint32_t QuadTree::split(uint32_t index) {
+    // Child building, geometry comes from the parent during traversal
+    assert(nodes[index].isLeaf() && "Node already has children");
+    
+    int level = nodes[index].getLevel() + 1;
+    uint8_t flags = static_cast<uint8_t>(PackedNode::LEAF | (level << PackedNode::LEVEL_SHIFT));
+    uint32_t first = static_cast<uint32_t>(nodes.size());
+    nodes.insert(nodes.end(), 4, {Pixel(0, 0, 0), flags, PackedNode::NO_CHILD});
+    
+    nodes[index].flags &= ~PackedNode::LEAF;
+    nodes[index].firstChild = first;
+    
+    // one leaf becomes four
+    if (level >= static_cast<int>(levelCounts.size())) {
+        levelCounts.resize(level + 1, 0);
     }
+    levelCounts[level] += 4;
+    leafCount += 3;
+    modified = true;
+    return first;
 }
 
-int QuadTree::calculateDepth(shared_ptr<QuadTreeNode> node) {
-    // Method to calculate the depth of the QuadTree
-
-    if (!node) {
-        return 0;
+void QuadTree::collapse(uint32_t index) {
+    // subtrees are appended depth first, so everything from the child block on belongs to this node
+    if (nodes[index].isLeaf()) {
+        return;
     }
     
-    // if the node is a leaf
-    if (node->isLeaf()) {
-        return 1;
+    for (size_t i = nodes[index].firstChild; i < nodes.size(); ++i) {
+        levelCounts[nodes[i].getLevel()]--;
+        leafCount -= nodes[i].isLeaf() ? 1 : 0;
     }
-    
-    int maxChildDepth = 0;
-    for (const auto& child : node->getChildren()) {
-        if (child) {
-            maxChildDepth = max(maxChildDepth, calculateDepth(child));
-        }
+    while (levelCounts.back() == 0) {
+        levelCounts.pop_back();
     }
     
-    return 1 + maxChildDepth;
+    nodes.erase(nodes.begin() + nodes[index].firstChild, nodes.end());
+    nodes[index].flags |= PackedNode::LEAF;
+    nodes[index].firstChild = PackedNode::NO_CHILD;
+    leafCount++;
+    modified = true;
 }
 
-int QuadTree::countNodes(shared_ptr<QuadTreeNode> node) {
-    // Method to count the number of nodes in the QuadTree
-
-    if (!node) {
-        return 0;
-    }
+// fragment node i > 0 lands at base + i, in the same depth-first order a sequential build appends
+void QuadTree::attach(uint32_t index, const QuadTree& fragment) {
+    assert(nodes[index].isLeaf() && "Fragments replace leaves");
+    assert(fragment.nodes.front().getLevel() == nodes[index].getLevel() && "Fragment depth mismatch");
     
-    int count = 1;
+    const PackedNode& root = fragment.nodes.front();
+    nodes[index].color = root.color;
+    modified = true;
+    if (root.isLeaf()) {
+        return;
+    }
     
-    for (const auto& child : node->getChildren()) {
-        if (child) {
-            count += countNodes(child);
+    uint32_t base = static_cast<uint32_t>(nodes.size()) - 1;
+    nodes.reserve(nodes.size() + fragment.nodes.size() - 1);
+    for (size_t i = 1; i < fragment.nodes.size(); ++i) {
+        PackedNode node = fragment.nodes[i];
+        if (!node.isLeaf()) {
+            node.firstChild += base;
         }
+        nodes.push_back(node);
     }
+    nodes[index].flags &= ~PackedNode::LEAF;
+    nodes[index].firstChild = root.firstChild + base;
     
-    return count;
-}
\ No newline at end of file
+    if (fragment.levelCounts.size() > levelCounts.size()) {
+        levelCounts.resize(fragment.levelCounts.size(), 0);
+    }
+    for (size_t level = root.getLevel() + 1; level < fragment.levelCounts.size(); ++level) {
+        levelCounts[level] += fragment.levelCounts[level];
+    }
+    leafCount += fragment.leafCount - 1;
+}
+
+int QuadTree::getNodeCountAtDepth(int level) const {
+    return level >= 0 && level < static_cast<int>(levelCounts.size()) ? levelCounts[level] : 0;
+}
+
+QuadTreeNode QuadTree::makeNode(uint32_t index, int x, int y, int w, int h) const {
+    QuadTreeNode node(x, y, w, h);
+    node.color = nodes[index].color;
+    node.index = index;
+    node.firstChild = nodes[index].isLeaf() ? QuadTreeNode::NO_CHILD : nodes[index].firstChild;
+    return node;
+}
+
+QuadTreeNode QuadTree::getRoot() const {
+    return makeNode(0, rootX, rootY, width, height);
+}
+
+// same half/remainder partition as the builders
+QuadTreeNode QuadTree::getChild(const QuadTreeNode& node, int quadrant) const {
+    int halfWidth = node.width / 2;
+    int halfHeight = node.height / 2;
+    return makeNode(nodes[node.index].firstChild + quadrant,
+                    node.x + (quadrant & 1 ? halfWidth : 0),
+                    node.y + (quadrant & 2 ? halfHeight : 0),
+                    quadrant & 1 ? node.width - halfWidth : halfWidth,
+                    quadrant & 2 ? node.height - halfHeight : halfHeight);
+}
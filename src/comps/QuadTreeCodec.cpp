@@ -0,0 +1,790 @@
+// include header file
+#include "QuadTreeCodec.hpp"
+
+// include lib files
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+
+const unsigned char QuadTreeCodec::VERSION;
+const int QuadTreeCodec::MAX_INDEX_LEVELS;
+const size_t QuadTreeCodec::CHUNK_FAMILIES;
+
+static const unsigned char MAGIC[3] = {'Q', 'T', 'C'};
+
+// largest image side accepted by the decoder
+static const uint64_t MAX_SIDE = 1 << 20;
+
+
+// LEB128 varints for the header
+static void writeVarint(uint64_t value, vector<unsigned char>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<unsigned char>(value));
+}
+
+static bool readVarint(const unsigned char* data, size_t size, size_t& offset, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64 && offset < size; shift += 7) {
+        unsigned char byte = data[offset++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// median edge detector (LOCO-I): picks the neighbour across an edge, the gradient otherwise
+static inline unsigned char medianPredict(int left, int above, int corner) {
+    if (corner >= max(left, above)) {
+        return static_cast<unsigned char>(min(left, above));
+    }
+    if (corner <= min(left, above)) {
+        return static_cast<unsigned char>(max(left, above));
+    }
+    return static_cast<unsigned char>(left + above - corner);
+}
+
+
+QuadTreeCodec::Models::Models(int x, int y, int width, int height, const Pixel& start): originX(x), originY(y), above(width), left(height), previous(start) {
+    fill(&splits[0][0], &splits[0][0] + sizeof(splits) / sizeof(BitModel), BIT_MODEL_INIT);
+    fill(&colors[0][0][0], &colors[0][0][0] + sizeof(colors) / sizeof(BitModel), BIT_MODEL_INIT);
+}
+
+BitModel* QuadTreeCodec::Models::splitModel(int level, int previousSplit) {
+    return &splits[min(level, SPLIT_LEVELS - 1)][previousSplit];
+}
+
+Pixel QuadTreeCodec::Models::predict(int x, int y, int& context) const {
+    context = 1;
+    x -= originX;
+    y -= originY;
+    if (x == 0 && y == 0) {
+        return previous;
+    }
+    if (x == 0) {
+        return above[x];
+    }
+    if (y == 0) {
+        return left[y];
+    }
+    
+    // corner: the last leaf seen in the column to the left, the left leaf itself when it
+    // reaches above y (then the median picks the leaf above across the edge)
+    const Pixel& a = above[x];
+    const Pixel& l = left[y];
+    const Pixel& c = above[x - 1];
+    if (a == l && l == c) {
+        context = 0;
+        return a;
+    }
+    return Pixel(medianPredict(l.r, a.r, c.r), medianPredict(l.g, a.g, c.g), medianPredict(l.b, a.b, c.b));
+}
+
+void QuadTreeCodec::Models::update(const QuadTreeNode& leaf, const Pixel& color) {
+    // every later leaf lies right of or below this one, so only its last row and column matter
+    int x = leaf.getX() - originX;
+    int y = leaf.getY() - originY;
+    fill(above.begin() + x, above.begin() + x + leaf.getWidth(), color);
+    fill(left.begin() + y, left.begin() + y + leaf.getHeight(), color);
+    previous = color;
+}
+
+
+QuadTreeCodec::LevelModels::LevelModels() {
+    fill(&splits[0][0], &splits[0][0] + sizeof(splits) / sizeof(BitModel), BIT_MODEL_INIT);
+    fill(&colors[0][0][0][0], &colors[0][0][0][0] + sizeof(colors) / sizeof(BitModel), BIT_MODEL_INIT);
+}
+
+BitModel* QuadTreeCodec::LevelModels::splitModel(int level, int splitSiblings) {
+    return &splits[min(level, LEVELS - 1)][splitSiblings];
+}
+
+BitModel* QuadTreeCodec::LevelModels::colorModels(int level, int quadrant) {
+    return colors[min(level, LEVELS - 1)][quadrant == 3 ? 1 : 0][0];
+}
+
+
+void QuadTreeCodec::writeHeader(const Header& header, vector<unsigned char>& out) {
+    out.insert(out.end(), MAGIC, MAGIC + 3);
+    out.push_back(VERSION);
+    out.push_back(static_cast<unsigned char>(header.layout));
+    writeVarint(static_cast<uint64_t>(header.width), out);
+    writeVarint(static_cast<uint64_t>(header.height), out);
+    writeVarint(header.splitArea, out);
+    writeVarint(header.nodeCount, out);
+    if (header.layout == Layout::INDEXED) {
+        writeVarint(static_cast<uint64_t>(header.indexLevels), out);
+        writeVarint(header.topSize, out);
+        writeVarint(header.indexSize, out);
+    }
+}
+
+bool QuadTreeCodec::readHeader(const unsigned char* data, size_t size, Header& header, size_t& offset) {
+    if (size < 5 || !equal(MAGIC, MAGIC + 3, data)) {
+        cerr << "Not a quadtree stream" << endl;
+        return false;
+    }
+    if (data[3] != VERSION) {
+        cerr << "Unsupported quadtree stream version: " << static_cast<int>(data[3]) << endl;
+        return false;
+    }
+    if (data[4] > static_cast<unsigned char>(Layout::INDEXED)) {
+        cerr << "Unknown quadtree stream layout: " << static_cast<int>(data[4]) << endl;
+        return false;
+    }
+    header.layout = static_cast<Layout>(data[4]);
+    
+    offset = 5;
+    uint64_t width = 0, height = 0;
+    if (!readVarint(data, size, offset, width) || !readVarint(data, size, offset, height) ||
+        !readVarint(data, size, offset, header.splitArea) || !readVarint(data, size, offset, header.nodeCount)) {
+        cerr << "Truncated quadtree stream header" << endl;
+        return false;
+    }
+    
+    // every split adds 4 nodes and covers at least 4 pixels; a split area of 0 would let
+    // blocks narrower than 2 pixels split into empty children
+    uint64_t maxNodes = width * height / 3 * 4 + 1;
+    if (width == 0 || height == 0 || width > MAX_SIDE || height > MAX_SIDE || header.splitArea == 0 ||
+        header.nodeCount == 0 || header.nodeCount > maxNodes || header.nodeCount % 4 != 1) {
+        cerr << "Invalid quadtree stream header" << endl;
+        return false;
+    }
+    header.width = static_cast<int>(width);
+    header.height = static_cast<int>(height);
+    
+    header.indexLevels = 0;
+    header.topSize = 0;
+    header.indexSize = 0;
+    if (header.layout == Layout::INDEXED) {
+        uint64_t levels = 0;
+        if (!readVarint(data, size, offset, levels) || !readVarint(data, size, offset, header.topSize) || !readVarint(data, size, offset, header.indexSize)) {
+            cerr << "Truncated quadtree stream header" << endl;
+            return false;
+        }
+        if (levels == 0 || levels > MAX_INDEX_LEVELS) {
+            cerr << "Invalid quadtree stream header" << endl;
+            return false;
+        }
+        header.indexLevels = static_cast<int>(levels);
+    }
+    return true;
+}
+
+// next complete chunk before end, false when it is cut off (or there is none)
+bool QuadTreeCodec::readChunk(const unsigned char* data, size_t end, size_t& offset, const unsigned char*& chunk, size_t& chunkSize) {
+    size_t position = offset;
+    uint64_t length = 0;
+    if (!readVarint(data, end, position, length) || length > end - position) {
+        return false;
+    }
+    chunk = data + position;
+    chunkSize = static_cast<size_t>(length);
+    offset = position + chunkSize;
+    return true;
+}
+
+
+// green first, its residual is taken off red and blue (channels move together)
+void QuadTreeCodec::encodeColor(const Pixel& prediction, const Pixel& color, BitModel* models, RangeEncoder& encoder) {
+    int green = (color.g - prediction.g) & 0xFF;
+    encoder.encodeTree(models, 8, green);
+    encoder.encodeTree(models + 256, 8, (color.r - prediction.r - green) & 0xFF);
+    encoder.encodeTree(models + 512, 8, (color.b - prediction.b - green) & 0xFF);
+}
+
+Pixel QuadTreeCodec::decodeColor(const Pixel& prediction, BitModel* models, RangeDecoder& decoder) {
+    int green = decoder.decodeTree(models, 8);
+    int red = decoder.decodeTree(models + 256, 8);
+    int blue = decoder.decodeTree(models + 512, 8);
+    return Pixel(static_cast<unsigned char>(prediction.r + red + green),
+                 static_cast<unsigned char>(prediction.g + green),
+                 static_cast<unsigned char>(prediction.b + blue + green));
+}
+
+
+bool QuadTreeCodec::encode(const QuadTree& tree, vector<unsigned char>& out, Layout layout, int indexLevels) {
+    if (tree.empty()) {
+        cerr << "No quadtree to encode" << endl;
+        return false;
+    }
+    if (layout == Layout::INDEXED && (indexLevels < 1 || indexLevels > MAX_INDEX_LEVELS)) {
+        cerr << "Index levels must be between 1 and " << MAX_INDEX_LEVELS << endl;
+        return false;
+    }
+    
+    // the smallest split block decides which blocks need a flag at all
+    Header header = {layout, tree.getWidth(), tree.getHeight(), 0, tree.size(), 0, 0, 0};
+    uint64_t minSplitArea = splitArea(tree.getRoot()) + 1;
+    vector<QuadTreeNode> stack(1, tree.getRoot());
+    while (!stack.empty()) {
+        QuadTreeNode node = stack.back();
+        stack.pop_back();
+        if (!node.isLeaf()) {
+            minSplitArea = min(minSplitArea, splitArea(node));
+            for (int k = 0; k < 4; ++k) {
+                stack.push_back(tree.getChild(node, k));
+            }
+        }
+    }
+    header.splitArea = max<uint64_t>(1, minSplitArea);
+    
+    out.clear();
+    if (layout == Layout::INDEXED) {
+        header.indexLevels = indexLevels;
+        encodeIndexed(tree, header, out);
+        return true;
+    }
+    writeHeader(header, out);
+    
+    if (layout == Layout::BREADTH_FIRST) {
+        encodeLevels(tree, header, out);
+        return true;
+    }
+    
+    Models models(0, 0, header.width, header.height, Pixel(128, 128, 128));
+    RangeEncoder encoder(out);
+    encodeNode(tree, tree.getRoot(), header, 1, models, encoder, nullptr);
+    encoder.flush();
+    return true;
+}
+
+bool QuadTreeCodec::decode(const unsigned char* data, size_t size, QuadTree& tree) {
+    Header header;
+    size_t offset = 0;
+    if (!readHeader(data, size, header, offset)) {
+        return false;
+    }
+    
+    bool decoded;
+    if (header.layout == Layout::BREADTH_FIRST) {
+        decoded = decodeLevels(data, size, offset, header, 0, tree);
+    } else if (header.layout == Layout::INDEXED) {
+        decoded = decodeIndexed(data, size, offset, header, nullptr, tree);
+    } else {
+        tree.reset(header.width, header.height);
+        // the announced count is untrusted, the reserve is only a hint up to what the payload could hold
+        tree.reserve(static_cast<size_t>(min<uint64_t>(header.nodeCount, static_cast<uint64_t>(size - offset) * 8 + 1)));
+        
+        Models models(0, 0, header.width, header.height, Pixel(128, 128, 128));
+        RangeDecoder decoder(data + offset, size - offset);
+        decoded = decodeNode(tree, tree.getRoot(), header, 1, models, decoder, nullptr) && !decoder.overran();
+    }
+    
+    if (!decoded || tree.size() != header.nodeCount) {
+        cerr << "Corrupt quadtree stream" << endl;
+        tree = QuadTree();
+        return false;
+    }
+    return true;
+}
+
+bool QuadTreeCodec::decodePartial(const unsigned char* data, size_t size, QuadTree& tree, size_t byteBudget, int depthLimit) {
+    Header header;
+    size_t offset = 0;
+    size_t end = byteBudget > 0 ? min(size, byteBudget) : size;
+    if (!readHeader(data, end, header, offset)) {
+        return false;
+    }
+    if (header.layout != Layout::BREADTH_FIRST) {
+        cerr << "Only breadth-first quadtree streams can be decoded partially" << endl;
+        return false;
+    }
+    
+    if (!decodeLevels(data, end, offset, header, depthLimit, tree)) {
+        cerr << "Corrupt quadtree stream" << endl;
+        tree = QuadTree();
+        return false;
+    }
+    return true;
+}
+
+
+void QuadTreeCodec::encodeNode(const QuadTree& tree, const QuadTreeNode& node, const Header& header, int previousSplit, Models& models, RangeEncoder& encoder, vector<QuadTreeNode>* tiles) {
+    int level = tree.getPacked(node.getIndex()).getLevel();
+    int split = node.isLeaf() ? 0 : 1;
+    if (splitArea(node) >= header.splitArea) {
+        encoder.encodeBit(*models.splitModel(level, previousSplit), split);
+    }
+    
+    // leaves and tiles carry their color, the tile content goes to its own segment
+    bool tile = tiles && level == header.indexLevels;
+    if (!split || tile) {
+        int context = 0;
+        Pixel prediction = models.predict(node.getX(), node.getY(), context);
+        encodeColor(prediction, node.getColor(), models.colorModels(context), encoder);
+        models.update(node, node.getColor());
+        if (split) {
+            tiles->push_back(node);
+        }
+        return;
+    }
+    
+    encodeChildren(tree, node, header, models, encoder, tiles);
+}
+
+void QuadTreeCodec::encodeChildren(const QuadTree& tree, const QuadTreeNode& node, const Header& header, Models& models, RangeEncoder& encoder, vector<QuadTreeNode>* tiles) {
+    int childSplit = 1;
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(node, i);
+        encodeNode(tree, child, header, childSplit, models, encoder, tiles);
+        childSplit = child.isLeaf() ? 0 : 1;
+    }
+}
+
+bool QuadTreeCodec::decodeNode(QuadTree& tree, const QuadTreeNode& node, const Header& header, int previousSplit, Models& models, RangeDecoder& decoder, vector<QuadTreeNode>* tiles) {
+    const uint32_t index = node.getIndex();
+    int level = tree.getPacked(index).getLevel();
+    int split = 0;
+    if (splitArea(node) >= header.splitArea) {
+        split = decoder.decodeBit(*models.splitModel(level, previousSplit));
+    }
+    
+    // a split tile stays a leaf until its segment is decoded
+    bool tile = tiles && level == header.indexLevels;
+    if (!split || tile) {
+        int context = 0;
+        Pixel prediction = models.predict(node.getX(), node.getY(), context);
+        Pixel color = decodeColor(prediction, models.colorModels(context), decoder);
+        models.update(node, color);
+        tree.setColor(index, color);
+        if (split) {
+            tiles->push_back(node);
+        }
+        return true;
+    }
+    
+    if (!decodeChildren(tree, node, header, models, decoder, tiles)) {
+        return false;
+    }
+    tree.setColor(index, meanOfChildren(tree, node));
+    return true;
+}
+
+bool QuadTreeCodec::decodeChildren(QuadTree& tree, const QuadTreeNode& node, const Header& header, Models& models, RangeDecoder& decoder, vector<QuadTreeNode>* tiles) {
+    // a corrupt stream must not grow the arena past the announced size
+    if (tree.size() + 4 > header.nodeCount) {
+        return false;
+    }
+    tree.split(node.getIndex());
+    
+    int childSplit = 1;
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(node, i);
+        size_t tileCount = tiles ? tiles->size() : 0;
+        if (!decodeNode(tree, child, header, childSplit, models, decoder, tiles)) {
+            return false;
+        }
+        // a split tile is still a leaf here, it counts as split like in the encoder
+        bool splitTile = tiles && tiles->size() > tileCount;
+        childSplit = tree.getPacked(child.getIndex()).isLeaf() && !splitTile ? 0 : 1;
+    }
+    return true;
+}
+
+// internal blocks are not stored, the area-weighted mean of the children stands in
+Pixel QuadTreeCodec::meanOfChildren(const QuadTree& tree, const QuadTreeNode& node) {
+    uint64_t sum[3] = {0, 0, 0};
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(node, i);
+        uint64_t area = static_cast<uint64_t>(child.getWidth()) * child.getHeight();
+        sum[0] += area * child.getColor().r;
+        sum[1] += area * child.getColor().g;
+        sum[2] += area * child.getColor().b;
+    }
+    uint64_t area = static_cast<uint64_t>(node.getWidth()) * node.getHeight();
+    return Pixel(static_cast<unsigned char>((sum[0] + area / 2) / area),
+                 static_cast<unsigned char>((sum[1] + area / 2) / area),
+                 static_cast<unsigned char>((sum[2] + area / 2) / area));
+}
+
+
+// top segment, index and one segment per split tile; the header goes last, it holds the sizes
+void QuadTreeCodec::encodeIndexed(const QuadTree& tree, Header& header, vector<unsigned char>& out) {
+    vector<unsigned char> top, index, segments;
+    vector<QuadTreeNode> tiles;
+    {
+        Models models(0, 0, header.width, header.height, Pixel(128, 128, 128));
+        RangeEncoder encoder(top);
+        encodeNode(tree, tree.getRoot(), header, 1, models, encoder, &tiles);
+        encoder.flush();
+    }
+    
+    writeVarint(tiles.size(), index);
+    for (const QuadTreeNode& tile : tiles) {
+        size_t start = segments.size();
+        Models models(tile.getX(), tile.getY(), tile.getWidth(), tile.getHeight(), tile.getColor());
+        RangeEncoder encoder(segments);
+        encodeChildren(tree, tile, header, models, encoder, nullptr);
+        encoder.flush();
+        writeVarint(segments.size() - start, index);
+    }
+    
+    header.topSize = top.size();
+    header.indexSize = index.size();
+    writeHeader(header, out);
+    out.insert(out.end(), top.begin(), top.end());
+    out.insert(out.end(), index.begin(), index.end());
+    out.insert(out.end(), segments.begin(), segments.end());
+}
+
+// data holds the stream at least up to the end of the index, tileCount is what decodeTop found;
+// the count is checked before anything is sized by it
+bool QuadTreeCodec::readIndex(const unsigned char* data, size_t offset, const Header& header, size_t tileCount, TileIndex& index) {
+    size_t position = offset + header.topSize;
+    size_t end = position + header.indexSize;
+    uint64_t count = 0;
+    if (!readVarint(data, end, position, count) || count != tileCount || count > header.indexSize) {
+        return false;
+    }
+    
+    index.offsets.resize(count);
+    index.sizes.resize(count);
+    uint64_t segmentOffset = end;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (!readVarint(data, end, position, index.sizes[i])) {
+            return false;
+        }
+        index.offsets[i] = segmentOffset;
+        segmentOffset += index.sizes[i];
+    }
+    return true;
+}
+
+// tree down to the tile level, split tiles are left as leaves in the order of the index
+bool QuadTreeCodec::decodeTop(const unsigned char* data, size_t offset, const Header& header, QuadTree& tree, vector<QuadTreeNode>& tiles) {
+    tree.reset(header.width, header.height);
+    tiles.clear();
+    
+    Models models(0, 0, header.width, header.height, Pixel(128, 128, 128));
+    RangeDecoder decoder(data + offset, static_cast<size_t>(header.topSize));
+    return decodeNode(tree, tree.getRoot(), header, 1, models, decoder, &tiles) && !decoder.overran();
+}
+
+bool QuadTreeCodec::decodeTile(const unsigned char* data, size_t size, const Header& header, QuadTree& tree, const QuadTreeNode& tile) {
+    Models models(tile.getX(), tile.getY(), tile.getWidth(), tile.getHeight(), tree.getPacked(tile.getIndex()).color);
+    RangeDecoder decoder(data, size);
+    return decodeChildren(tree, tile, header, models, decoder, nullptr) && !decoder.overran();
+}
+
+// region null decodes every tile
+bool QuadTreeCodec::decodeIndexed(const unsigned char* data, size_t size, size_t offset, const Header& header, const Region* region, QuadTree& tree) {
+    if (header.topSize > size - offset || header.indexSize > size - offset - header.topSize) {
+        return false;
+    }
+    
+    TileIndex index;
+    vector<QuadTreeNode> tiles;
+    if (!decodeTop(data, offset, header, tree, tiles) || !readIndex(data, offset, header, tiles.size(), index)) {
+        return false;
+    }
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        if (!intersects(tiles[i], region)) {
+            continue;
+        }
+        if (index.offsets[i] > size || index.sizes[i] > size - index.offsets[i] ||
+            !decodeTile(data + index.offsets[i], static_cast<size_t>(index.sizes[i]), header, tree, tiles[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool QuadTreeCodec::intersects(const QuadTreeNode& node, const Region* region) {
+    return !region || (node.getX() < region->x + region->width && region->x < node.getX() + node.getWidth() &&
+                       node.getY() < region->y + region->height && region->y < node.getY() + node.getHeight());
+}
+
+bool QuadTreeCodec::decodeRegion(const unsigned char* data, size_t size, QuadTree& tree, int x, int y, int width, int height) {
+    Header header;
+    size_t offset = 0;
+    if (!readHeader(data, size, header, offset)) {
+        return false;
+    }
+    if (header.layout != Layout::INDEXED) {
+        return decode(data, size, tree);
+    }
+    
+    Region region = {x, y, width, height};
+    if (!decodeIndexed(data, size, offset, header, &region, tree)) {
+        cerr << "Corrupt quadtree stream" << endl;
+        tree = QuadTree();
+        return false;
+    }
+    return true;
+}
+
+
+// the parent color is the mean of its children, so the last child is nearly determined by
+// the other three; the others are predicted as the parent color
+class FamilyPredictor {
+    public:
+        explicit FamilyPredictor(const QuadTreeNode& parent): parent(parent.getColor()) {
+            int64_t area = static_cast<int64_t>(parent.getWidth()) * parent.getHeight();
+            remainder[0] = area * this->parent.r;
+            remainder[1] = area * this->parent.g;
+            remainder[2] = area * this->parent.b;
+        }
+        
+        Pixel predict(const QuadTreeNode& child, int quadrant) const {
+            if (quadrant < 3) {
+                return parent;
+            }
+            int64_t area = static_cast<int64_t>(child.getWidth()) * child.getHeight();
+            return Pixel(channel(remainder[0], area), channel(remainder[1], area), channel(remainder[2], area));
+        }
+        
+        void add(const QuadTreeNode& child, const Pixel& color) {
+            int64_t area = static_cast<int64_t>(child.getWidth()) * child.getHeight();
+            remainder[0] -= area * color.r;
+            remainder[1] -= area * color.g;
+            remainder[2] -= area * color.b;
+        }
+    
+    private:
+        Pixel parent;
+        int64_t remainder[3];
+        
+        static unsigned char channel(int64_t sum, int64_t area) {
+            return static_cast<unsigned char>(max<int64_t>(0, min<int64_t>(255, (sum + area / 2) / area)));
+        }
+};
+
+// first chunk: root color and flag, then every level in chunks of whole families
+void QuadTreeCodec::encodeLevels(const QuadTree& tree, const Header& header, vector<unsigned char>& out) {
+    LevelModels models;
+    vector<unsigned char> payload;
+    vector<QuadTreeNode> frontier, next;
+    
+    QuadTreeNode root = tree.getRoot();
+    {
+        RangeEncoder encoder(payload);
+        encodeColor(Pixel(128, 128, 128), root.getColor(), models.colorModels(0, 0), encoder);
+        if (splitArea(root) >= header.splitArea) {
+            encoder.encodeBit(*models.splitModel(0, 0), root.isLeaf() ? 0 : 1);
+        }
+        encoder.flush();
+    }
+    writeVarint(payload.size(), out);
+    out.insert(out.end(), payload.begin(), payload.end());
+    if (!root.isLeaf()) {
+        frontier.push_back(root);
+    }
+    
+    while (!frontier.empty()) {
+        for (size_t first = 0; first < frontier.size(); first += CHUNK_FAMILIES) {
+            payload.clear();
+            RangeEncoder encoder(payload);
+            size_t last = min(frontier.size(), first + CHUNK_FAMILIES);
+            for (size_t i = first; i < last; ++i) {
+                encodeFamily(tree, frontier[i], header, models, encoder, next);
+            }
+            encoder.flush();
+            writeVarint(payload.size(), out);
+            out.insert(out.end(), payload.begin(), payload.end());
+        }
+        frontier.swap(next);
+        next.clear();
+    }
+}
+
+// the four children of a split block: color against the parent's, then the split flag
+void QuadTreeCodec::encodeFamily(const QuadTree& tree, const QuadTreeNode& parent, const Header& header, LevelModels& models, RangeEncoder& encoder, vector<QuadTreeNode>& next) {
+    int level = tree.getPacked(parent.getIndex()).getLevel() + 1;
+    int splitSiblings = 0;
+    FamilyPredictor predictor(parent);
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(parent, i);
+        encodeColor(predictor.predict(child, i), child.getColor(), models.colorModels(level, i), encoder);
+        predictor.add(child, child.getColor());
+        if (splitArea(child) >= header.splitArea) {
+            int split = child.isLeaf() ? 0 : 1;
+            encoder.encodeBit(*models.splitModel(level, splitSiblings), split);
+            if (split) {
+                splitSiblings++;
+                next.push_back(child);
+            }
+        }
+    }
+}
+
+// stops quietly at the first chunk that is cut off by end or the first level past depthLimit
+bool QuadTreeCodec::decodeLevels(const unsigned char* data, size_t end, size_t offset, const Header& header, int depthLimit, QuadTree& tree) {
+    tree.reset(header.width, header.height);
+    
+    const unsigned char* chunk = nullptr;
+    size_t chunkSize = 0;
+    if (!readChunk(data, end, offset, chunk, chunkSize)) {
+        return false;
+    }
+    
+    LevelModels models;
+    vector<QuadTreeNode> frontier, next;
+    {
+        RangeDecoder decoder(chunk, chunkSize);
+        tree.setColor(0, decodeColor(Pixel(128, 128, 128), models.colorModels(0, 0), decoder));
+        QuadTreeNode root = tree.getRoot();
+        if (splitArea(root) >= header.splitArea && decoder.decodeBit(*models.splitModel(0, 0))) {
+            frontier.push_back(root);
+        }
+        if (decoder.overran()) {
+            return false;
+        }
+    }
+    
+    for (int level = 1; !frontier.empty() && (depthLimit <= 0 || level < depthLimit); ++level) {
+        for (size_t first = 0; first < frontier.size(); first += CHUNK_FAMILIES) {
+            if (!readChunk(data, end, offset, chunk, chunkSize)) {
+                return true;
+            }
+            
+            RangeDecoder decoder(chunk, chunkSize);
+            size_t last = min(frontier.size(), first + CHUNK_FAMILIES);
+            for (size_t i = first; i < last; ++i) {
+                if (!decodeFamily(tree, frontier[i], header, models, decoder, next)) {
+                    return false;
+                }
+            }
+            if (decoder.overran()) {
+                return false;
+            }
+        }
+        frontier.swap(next);
+        next.clear();
+    }
+    return true;
+}
+
+bool QuadTreeCodec::decodeFamily(QuadTree& tree, const QuadTreeNode& parent, const Header& header, LevelModels& models, RangeDecoder& decoder, vector<QuadTreeNode>& next) {
+    // a corrupt stream must not grow the arena past the announced size
+    if (tree.size() + 4 > header.nodeCount) {
+        return false;
+    }
+    tree.split(parent.getIndex());
+    
+    int level = tree.getPacked(parent.getIndex()).getLevel() + 1;
+    int splitSiblings = 0;
+    FamilyPredictor predictor(parent);
+    for (int i = 0; i < 4; ++i) {
+        QuadTreeNode child = tree.getChild(parent, i);
+        Pixel color = decodeColor(predictor.predict(child, i), models.colorModels(level, i), decoder);
+        predictor.add(child, color);
+        tree.setColor(child.getIndex(), color);
+        if (splitArea(child) >= header.splitArea && decoder.decodeBit(*models.splitModel(level, splitSiblings))) {
+            splitSiblings++;
+            next.push_back(tree.getChild(parent, i));
+        }
+    }
+    return true;
+}
+
+
+bool QuadTreeCodec::writeFile(const string& path, const QuadTree& tree, size_t& bytesWritten, Layout layout, int indexLevels) {
+    vector<unsigned char> buffer;
+    if (!encode(tree, buffer, layout, indexLevels)) {
+        return false;
+    }
+    
+    ofstream file(path, ios::binary);
+    if (!file || !file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size())) {
+        cerr << "Failed to write quadtree stream: " << path << endl;
+        return false;
+    }
+    bytesWritten = buffer.size();
+    return true;
+}
+
+bool QuadTreeCodec::readFile(const string& path, QuadTree& tree) {
+    ifstream file(path, ios::binary);
+    if (!file) {
+        cerr << "Failed to open quadtree stream: " << path << endl;
+        return false;
+    }
+    vector<unsigned char> buffer((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+    return decode(buffer.data(), buffer.size(), tree);
+}
+
+// a budget stops the read itself, the rest of the file is never touched
+bool QuadTreeCodec::readFilePartial(const string& path, QuadTree& tree, size_t byteBudget, int depthLimit) {
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        cerr << "Failed to open quadtree stream: " << path << endl;
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+    
+    // the buffer never grows past the file, whatever the budget
+    vector<unsigned char> buffer;
+    if (byteBudget > 0) {
+        byteBudget = static_cast<size_t>(min<uint64_t>(byteBudget, fileSize));
+        buffer.resize(byteBudget);
+        file.read(reinterpret_cast<char*>(buffer.data()), static_cast<streamsize>(byteBudget));
+        buffer.resize(static_cast<size_t>(file.gcount()));
+    } else {
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    }
+    return decodePartial(buffer.data(), buffer.size(), tree, 0, depthLimit);
+}
+
+// reads the header, the top and the index, then seeks to each tile of the region
+bool QuadTreeCodec::readFileRegion(const string& path, QuadTree& tree, int x, int y, int width, int height) {
+    ifstream file(path, ios::binary | ios::ate);
+    if (!file) {
+        cerr << "Failed to open quadtree stream: " << path << endl;
+        return false;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+    file.seekg(0);
+    
+    // largest possible header: 5 bytes and 7 varints
+    vector<unsigned char> prefix(static_cast<size_t>(min<uint64_t>(fileSize, 5 + 7 * 10)));
+    file.read(reinterpret_cast<char*>(prefix.data()), static_cast<streamsize>(prefix.size()));
+    Header header;
+    size_t offset = 0;
+    if (!file || !readHeader(prefix.data(), prefix.size(), header, offset)) {
+        return false;
+    }
+    if (header.layout != Layout::INDEXED) {
+        file.close();
+        return readFile(path, tree);
+    }
+    
+    bool decoded = header.topSize <= fileSize - offset && header.indexSize <= fileSize - offset - header.topSize;
+    TileIndex index;
+    vector<QuadTreeNode> tiles;
+    if (decoded) {
+        prefix.resize(static_cast<size_t>(offset + header.topSize + header.indexSize));
+        file.seekg(0);
+        decoded = file.read(reinterpret_cast<char*>(prefix.data()), static_cast<streamsize>(prefix.size())) &&
+                  decodeTop(prefix.data(), offset, header, tree, tiles) && readIndex(prefix.data(), offset, header, tiles.size(), index);
+    }
+    
+    Region region = {x, y, width, height};
+    vector<unsigned char> segment;
+    for (size_t i = 0; decoded && i < tiles.size(); ++i) {
+        if (!intersects(tiles[i], &region)) {
+            continue;
+        }
+        if (index.offsets[i] > fileSize || index.sizes[i] > fileSize - index.offsets[i]) {
+            decoded = false;
+            break;
+        }
+        segment.resize(static_cast<size_t>(index.sizes[i]));
+        file.seekg(static_cast<streamoff>(index.offsets[i]));
+        decoded = file.read(reinterpret_cast<char*>(segment.data()), static_cast<streamsize>(segment.size())) &&
+                  decodeTile(segment.data(), segment.size(), header, tree, tiles[i]);
+    }
+    
+    if (!decoded) {
+        cerr << "Corrupt quadtree stream" << endl;
+        tree = QuadTree();
+        return false;
+    }
+    return true;
+}
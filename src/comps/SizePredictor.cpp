@@ -0,0 +1,60 @@
+// include header file
+#include "SizePredictor.hpp"
+
+// include lib files
+#include <algorithm>
+#include <cmath>
+
+
+TreeFeatures SizePredictor::measure(const QuadTree& tree) {
+    TreeFeatures features = {0, 0};
+    tree.forEachLeaf([&](const QuadTreeNode& node) {
+        features.rowRuns += node.getHeight();
+        features.columnRuns += node.getWidth();
+    });
+    return features;
+}
+
+double SizePredictor::logRuns(const TreeFeatures& features) {
+    return log(static_cast<double>(max<uint64_t>(1, features.rowRuns + features.columnRuns)));
+}
+
+// a second encode of the same run count replaces the first
+void SizePredictor::addSample(const TreeFeatures& features, size_t encodedBytes) {
+    Sample sample = {logRuns(features), log(static_cast<double>(max<size_t>(1, encodedBytes)))};
+    auto position = lower_bound(samples.begin(), samples.end(), sample, [](const Sample& a, const Sample& b) {
+        return a.logRuns < b.logRuns;
+    });
+    if (position != samples.end() && position->logRuns == sample.logRuns) {
+        *position = sample;
+    } else {
+        samples.insert(position, sample);
+    }
+}
+
+size_t SizePredictor::predict(const TreeFeatures& features) const {
+    if (samples.empty()) {
+        return 0;
+    }
+    if (samples.size() == 1) {
+        return static_cast<size_t>(exp(samples[0].logBytes));
+    }
+    
+    double x = logRuns(features);
+    auto upper = upper_bound(samples.begin(), samples.end(), x, [](double value, const Sample& sample) {
+        return value < sample.logRuns;
+    });
+    
+    // bracketing pair, or the outermost pair when extrapolating
+    size_t right = min(max<size_t>(upper - samples.begin(), 1), samples.size() - 1);
+    const Sample& a = samples[right - 1];
+    const Sample& b = samples[right];
+    
+    double slope = (b.logBytes - a.logBytes) / (b.logRuns - a.logRuns);
+    if (x < a.logRuns || x > b.logRuns) {
+        // outside the calibrated range only trust a sane growth rate
+        slope = max(0.0, min(2.0, slope));
+    }
+    const Sample& anchor = x < a.logRuns ? a : (x > b.logRuns ? b : a);
+    return static_cast<size_t>(exp(anchor.logBytes + slope * (x - anchor.logRuns)));
+}
@@ -0,0 +1,146 @@
+// include header file
+#include "WorkStealingPool.hpp"
+
+// include lib files
+#include <chrono>
+
+
+// queue of the current thread (workers know their pool and slot)
+static thread_local const WorkStealingPool* currentPool = nullptr;
+static thread_local size_t currentQueue = 0;
+
+
+WorkStealingPool::WorkStealingPool(unsigned threadCount): stopping(false), queued(0) {
+    unsigned workerCount = threadCount > 1 ? threadCount - 1 : 0;
+    for (unsigned i = 0; i <= workerCount; ++i) {
+        queues.push_back(make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < workerCount; ++i) {
+        workers.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    }
+}
+
+WorkStealingPool::~WorkStealingPool() {
+    {
+        lock_guard<mutex> lock(sleepLock);
+        stopping = true;
+    }
+    wakeUp.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+size_t WorkStealingPool::homeQueue() const {
+    return currentPool == this ? currentQueue : queues.size() - 1;
+}
+
+void WorkStealingPool::spawn(TaskGroup& group, function<void()> task) {
+    group.pending.fetch_add(1, memory_order_relaxed);
+    {
+        Queue& queue = *queues[homeQueue()];
+        lock_guard<mutex> lock(queue.lock);
+        queue.tasks.push_back({move(task), &group});
+    }
+    queued.fetch_add(1, memory_order_release);
+    wakeUp.notify_one();
+}
+
+// own queue from the back, otherwise steal from the front of the others;
+// with only set, the first task of that group in the same order
+bool WorkStealingPool::runOne(size_t home, const TaskGroup* only) {
+    Task task;
+    bool found = false;
+    for (size_t k = 0; k < queues.size() && !found; ++k) {
+        Queue& queue = *queues[(home + k) % queues.size()];
+        lock_guard<mutex> lock(queue.lock);
+        if (queue.tasks.empty()) {
+            continue;
+        }
+        if (only) {
+            size_t count = queue.tasks.size();
+            for (size_t i = 0; i < count && !found; ++i) {
+                size_t position = k == 0 ? count - 1 - i : i;
+                if (queue.tasks[position].group == only) {
+                    task = move(queue.tasks[position]);
+                    queue.tasks.erase(queue.tasks.begin() + position);
+                    found = true;
+                }
+            }
+        } else if (k == 0) {
+            task = move(queue.tasks.back());
+            queue.tasks.pop_back();
+            found = true;
+        } else {
+            task = move(queue.tasks.front());
+            queue.tasks.pop_front();
+            found = true;
+        }
+    }
+    
+    if (!found) {
+        return false;
+    }
+    queued.fetch_sub(1, memory_order_relaxed);
+    execute(task);
+    return true;
+}
+
+void WorkStealingPool::execute(Task& task) {
+    try {
+        task.run();
+    } catch (...) {
+        lock_guard<mutex> lock(task.group->errorLock);
+        if (!task.group->error) {
+            task.group->error = current_exception();
+        }
+    }
+    
+    // under the lock, so a waiter that saw 0 cannot destroy the group while it is notified
+    TaskGroup& group = *task.group;
+    lock_guard<mutex> lock(group.doneLock);
+    if (group.pending.fetch_sub(1, memory_order_acq_rel) == 1) {
+        group.done.notify_all();
+    }
+}
+
+void WorkStealingPool::wait(TaskGroup& group) {
+    size_t home = homeQueue();
+    while (group.pending.load(memory_order_acquire) > 0) {
+        if (runOne(home, &group)) {
+            continue;
+        }
+        
+        // the rest of the group is running on other threads
+        unique_lock<mutex> lock(group.doneLock);
+        group.done.wait(lock, [&group] { return group.pending.load(memory_order_acquire) == 0; });
+    }
+    
+    // the last task may still hold the lock after its decrement
+    {
+        lock_guard<mutex> lock(group.doneLock);
+    }
+    
+    if (group.error) {
+        exception_ptr error = group.error;
+        group.error = nullptr;
+        rethrow_exception(error);
+    }
+}
+
+void WorkStealingPool::workerLoop(size_t index) {
+    currentPool = this;
+    currentQueue = index;
+    
+    while (!stopping) {
+        if (runOne(index, nullptr)) {
+            continue;
+        }
+        
+        // nothing to steal: sleep until a spawn (timeout guards against a missed wake-up)
+        unique_lock<mutex> lock(sleepLock);
+        wakeUp.wait_for(lock, chrono::milliseconds(2), [this] {
+            return stopping || queued.load(memory_order_acquire) > 0;
+        });
+    }
+}
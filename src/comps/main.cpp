@@ -1,11 +1,15 @@
 // include all necessary headers
 #include <chrono>
+#include <cerrno>
+#include <new>
 #include "QuadTree.hpp"
 #include "InputManager.hpp"
 #include "BasicInputManager.hpp"
 #include "ImageProcessor.hpp"
 #include "CompressionAnalyzer.hpp"
 #include "GifGenerator.hpp"
+#include "QuadTreeCodec.hpp"
+#include "LeafRasterizer.hpp"
 
 void printUsage() {
     cout << "Quadtree Image Compressor" << endl;
@@ -17,6 +21,252 @@ void printUsage() {
     cout << "2. Interactive Paging Mode: Run with arg \"page\"" << endl;
     cout << "   ./quadtree_compressor page" << endl;
     cout << endl;
+    cout << "Advanced options (after the mode):" << endl;
+    cout << "   --build=topdown|bottomup|bestfirst  quadtree construction strategy (default: topdown)" << endl;
+    cout << "   --dispatch=virtual|static  per-node virtual metric call or per-metric builder (default: virtual)" << endl;
+    cout << "   --threads=N                top-down build threads, 0 = all cores (default: 0)" << endl;
+    cout << "   --max-leaves=N             best-first build: stop before exceeding N leaves" << endl;
+    cout << "   --max-nodes=N              best-first build: stop before exceeding N nodes" << endl;
+    cout << "   --max-bytes=N              best-first build: stop before the output image exceeds N bytes, predicted" << endl;
+    cout << "                              from encodes of the growing tree and checked on the final one" << endl;
+    cout << "                              (any budget selects the best-first build)" << endl;
+    cout << "   --error-tree=on|off        target search reuses one full error tree (default: on)" << endl;
+    cout << "   --size-model=on|off        target search predicts sizes, encodes to calibrate and verify (default: on)" << endl;
+    cout << "   --png=rgb|palette          .png output as 24-bit color or indexed color from the leaf colors," << endl;
+    cout << "                              exact up to 256 colors, median cut beyond (default: rgb)" << endl;
+    cout << "   --qtc=PATH                 also save the quadtree itself as a .qtc stream" << endl;
+    cout << "   --qtc-layout=preorder|progressive  .qtc node order, progressive streams can be" << endl;
+    cout << "                              previewed from any prefix (default: preorder)" << endl;
+    cout << "   --qtc-index=K              preorder .qtc cut into tiles at level K (1-" << QuadTreeCodec::MAX_INDEX_LEVELS << ") with an" << endl;
+    cout << "                              offset index, for region decoding" << endl;
+    cout << endl;
+    cout << "3. Decode a .qtc stream to an image:" << endl;
+    cout << "   ./quadtree_compressor decode input.qtc output.png [--bytes=N] [--depth=N] [--region=X,Y,W,H]" << endl;
+    cout << "   --bytes=N                  progressive streams: read only the first N bytes" << endl;
+    cout << "   --depth=N                  progressive streams: decode only the first N levels" << endl;
+    cout << "   --region=X,Y,W,H           indexed streams: decode and save only this rectangle" << endl;
+    cout << endl;
+}
+
+// non-negative integer option value
+bool parseCount(const string& value, unsigned long long maxValue, unsigned long long& count) {
+    if (value.empty() || value[0] == '-') {
+        return false;
+    }
+    char* end = nullptr;
+    errno = 0;
+    count = strtoull(value.c_str(), &end, 10);
+    return *end == '\0' && errno == 0 && count <= maxValue;
+}
+
+// parse advanced --key=value options into params
+bool parseOptions(int argc, char* argv[], int first, CompressionParams& params) {
+    for (int i = first; i < argc; ++i) {
+        string arg = argv[i];
+        size_t separator = arg.find('=');
+        string key = arg.substr(0, separator);
+        string value = separator == string::npos ? "" : arg.substr(separator + 1);
+        
+        if (key == "--build") {
+            if (value == "topdown") {
+                params.buildMode = BuildMode::TOP_DOWN;
+            } else if (value == "bottomup") {
+                params.buildMode = BuildMode::BOTTOM_UP;
+            } else if (value == "bestfirst") {
+                params.buildMode = BuildMode::BEST_FIRST;
+            } else {
+                cout << "Unknown build mode: " << value << endl;
+                return false;
+            }
+        } else if (key == "--dispatch") {
+            if (value == "virtual") {
+                params.metricDispatch = MetricDispatch::VIRTUAL;
+            } else if (value == "static") {
+                params.metricDispatch = MetricDispatch::STATIC;
+            } else {
+                cout << "Unknown dispatch mode: " << value << endl;
+                return false;
+            }
+        } else if (key == "--threads") {
+            unsigned long long count = 0;
+            if (!parseCount(value, 1024, count)) {
+                cout << "Invalid thread count: " << value << endl;
+                return false;
+            }
+            params.threadCount = static_cast<int>(count);
+        } else if (key == "--error-tree") {
+            if (value == "on") {
+                params.useErrorTree = true;
+            } else if (value == "off") {
+                params.useErrorTree = false;
+            } else {
+                cout << "Unknown error tree setting: " << value << endl;
+                return false;
+            }
+        } else if (key == "--size-model") {
+            if (value == "on") {
+                params.useSizeModel = true;
+            } else if (value == "off") {
+                params.useSizeModel = false;
+            } else {
+                cout << "Unknown size model setting: " << value << endl;
+                return false;
+            }
+        } else if (key == "--png") {
+            if (value == "rgb") {
+                params.palettePng = false;
+            } else if (value == "palette") {
+                params.palettePng = true;
+            } else {
+                cout << "Unknown png mode: " << value << endl;
+                return false;
+            }
+        } else if (key == "--qtc") {
+            if (value.empty()) {
+                cout << "Missing path for --qtc" << endl;
+                return false;
+            }
+            params.streamOutputPath = value;
+        } else if (key == "--qtc-layout") {
+            if (value == "preorder") {
+                params.progressiveStream = false;
+            } else if (value == "progressive") {
+                params.progressiveStream = true;
+            } else {
+                cout << "Unknown stream layout: " << value << endl;
+                return false;
+            }
+        } else if (key == "--qtc-index") {
+            unsigned long long levels = 0;
+            if (!parseCount(value, QuadTreeCodec::MAX_INDEX_LEVELS, levels) || levels == 0) {
+                cout << "Invalid index levels: " << value << endl;
+                return false;
+            }
+            params.streamIndexLevels = static_cast<int>(levels);
+        } else if (key == "--max-leaves" || key == "--max-nodes" || key == "--max-bytes") {
+            unsigned long long count = 0;
+            if (!parseCount(value, numeric_limits<size_t>::max(), count)) {
+                cout << "Invalid budget: " << arg << endl;
+                return false;
+            }
+            size_t& budget = key == "--max-leaves" ? params.maxLeaves : key == "--max-nodes" ? params.maxNodes : params.maxBytes;
+            budget = static_cast<size_t>(count);
+        } else {
+            cout << "Unknown option: " << arg << endl;
+            return false;
+        }
+    }
+    if (params.progressiveStream && params.streamIndexLevels > 0) {
+        cout << "--qtc-index needs the preorder layout" << endl;
+        return false;
+    }
+    return true;
+}
+
+// count comma separated non-negative ints
+bool parseInts(const string& value, int count, int* numbers) {
+    size_t start = 0;
+    for (int i = 0; i < count; ++i) {
+        size_t comma = i < count - 1 ? value.find(',', start) : value.size();
+        unsigned long long number = 0;
+        if (comma == string::npos || !parseCount(value.substr(start, comma - start), numeric_limits<int>::max(), number)) {
+            return false;
+        }
+        numbers[i] = static_cast<int>(number);
+        start = comma + 1;
+    }
+    return true;
+}
+
+// X,Y,W,H
+bool parseRegion(const string& value, int region[4]) {
+    return parseInts(value, 4, region) && region[2] > 0 && region[3] > 0;
+}
+
+// .qtc stream back to an image, a budget or depth limit gives a preview, a region a crop
+int decodeStream(int argc, char* argv[]) {
+    string inputPath = argv[2];
+    string outputPath = argv[3];
+    unsigned long long byteBudget = 0;
+    unsigned long long depthLimit = 0;
+    int region[4] = {0, 0, 0, 0};
+    bool hasRegion = false;
+    for (int i = 4; i < argc; ++i) {
+        string arg = argv[i];
+        size_t separator = arg.find('=');
+        string key = arg.substr(0, separator);
+        string value = separator == string::npos ? "" : arg.substr(separator + 1);
+        bool valid = false;
+        if (key == "--bytes") {
+            valid = parseCount(value, numeric_limits<size_t>::max(), byteBudget);
+        } else if (key == "--depth") {
+            valid = parseCount(value, 255, depthLimit);
+        } else if (key == "--region") {
+            valid = hasRegion = parseRegion(value, region);
+        }
+        if (!valid) {
+            cout << "Invalid decode option: " << arg << endl;
+            printUsage();
+            return 1;
+        }
+    }
+    
+    auto start = chrono::high_resolution_clock::now();
+    
+    QuadTree quadTree;
+    bool partial = byteBudget > 0 || depthLimit > 0;
+    if (partial && hasRegion) {
+        cout << "--region cannot be combined with --bytes or --depth" << endl;
+        return 1;
+    }
+    bool decoded = false;
+    try {
+        if (hasRegion) {
+            decoded = QuadTreeCodec::readFileRegion(inputPath, quadTree, region[0], region[1], region[2], region[3]);
+        } else if (partial) {
+            decoded = QuadTreeCodec::readFilePartial(inputPath, quadTree, static_cast<size_t>(byteBudget), static_cast<int>(depthLimit));
+        } else {
+            decoded = QuadTreeCodec::readFile(inputPath, quadTree);
+        }
+    } catch (const bad_alloc&) {
+        // sizes in the stream are only checked against the image, not against memory
+        cerr << "Corrupt quadtree stream" << endl;
+    }
+    if (!decoded) {
+        cerr << "Failed to decode quadtree stream: " << inputPath << endl;
+        return 1;
+    }
+    
+    // whole image unless a region (clipped to the image) was asked for
+    int x = 0, y = 0, width = quadTree.getWidth(), height = quadTree.getHeight();
+    if (hasRegion) {
+        x = region[0];
+        y = region[1];
+        width = min(region[2], quadTree.getWidth() - x);
+        height = min(region[3], quadTree.getHeight() - y);
+        if (width <= 0 || height <= 0) {
+            cerr << "Region lies outside the " << quadTree.getWidth() << "x" << quadTree.getHeight() << " image" << endl;
+            return 1;
+        }
+    }
+    
+    // banded render on every core
+    unique_ptr<WorkStealingPool> pool;
+    if (thread::hardware_concurrency() > 1) {
+        pool = make_unique<WorkStealingPool>(thread::hardware_concurrency());
+    }
+    cv::Mat image(height, width, CV_8UC3);
+    LeafRasterizer::renderRegion(quadTree, x, y, width, height, image.ptr<unsigned char>(0), static_cast<size_t>(image.step), pool.get());
+    if (!cv::imwrite(outputPath, image)) {
+        cerr << "Failed to save image: " << outputPath << endl;
+        return 1;
+    }
+    
+    chrono::duration<double> elapsed = chrono::high_resolution_clock::now() - start;
+    cout << "Decoded " << width << "x" << height << " image from "
+         << quadTree.getLeafCount() << " leaves (depth " << quadTree.getDepth() << ") in "
+         << fixed << setprecision(3) << elapsed.count() << " seconds" << endl;
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
@@ -32,11 +282,24 @@ int main(int argc, char* argv[]) {
             useBasicMode = true;
         } else if (arg1 == "page") {   // paging mode
             useBasicMode = false;
+        } else if (arg1 == "decode") { // .qtc stream to image
+            if (argc < 4) {
+                printUsage();
+                return 1;
+            }
+            return decodeStream(argc, argv);
         } else {
             cout << "Unknown argument: " << arg1 << endl;
             printUsage();
             return 1;
         }
+        
+        // validate options before the interactive input starts
+        CompressionParams optionCheck;
+        if (!parseOptions(argc, argv, 2, optionCheck)) {
+            printUsage();
+            return 1;
+        }
     }
     
     // Get params
@@ -48,6 +311,13 @@ int main(int argc, char* argv[]) {
         InputManager inputManager;
         params = inputManager.getCompressionParams();
     }
+    parseOptions(argc, argv, 2, params);
+    
+    // the byte budget is measured in the output format
+    if (params.maxBytes > 0 && params.outputImagePath.find_last_of('.') == string::npos) {
+        cout << "--max-bytes needs an output extension" << endl;
+        return 1;
+    }
     
     // Process the image
     auto start = chrono::high_resolution_clock::now();
@@ -65,9 +335,13 @@ int main(int argc, char* argv[]) {
         return 1;
     }
     
+    if (!params.streamOutputPath.empty() && !processor.saveQuadTreeStream(params.streamOutputPath)) {
+        cerr << "Warning: Failed to save quadtree stream: " << params.streamOutputPath << endl;
+    }
+    
     if (params.generateGif && !params.gifOutputPath.empty()) {
         GifGenerator gifGen;
-        if (!gifGen.generateGif(quadTree, params.gifOutputPath)) {
+        if (!gifGen.generateGif(quadTree, params.gifOutputPath, processor.getRenderedImage())) {
             cerr << "Warning: Failed to generate GIF: " << params.gifOutputPath << endl;
         }
     }
@@ -18,6 +18,19 @@ enum class ErrorMethod {
     STRUCTURAL_SIMILARITY = 5
 };
 
+// Quadtree construction strategy
+enum class BuildMode {
+    TOP_DOWN = 1,  // error evaluated per node from the pixels
+    BOTTOM_UP = 2, // leaf statistics merged into parents (Variance, Max Pixel Difference, SSIM)
+    BEST_FIRST = 3 // highest-error leaf split first, until the threshold or a budget stops it
+};
+
+// How the top-down build reaches the error metric
+enum class MetricDispatch {
+    VIRTUAL = 1, // virtual call per node (default)
+    STATIC = 2   // builder instantiated per metric type, resolved once per build
+};
+
 // Compression parameters structure
 struct CompressionParams {
     string inputImagePath;
@@ -26,15 +39,43 @@ struct CompressionParams {
     int minBlockSize;
     double targetCompressionPercentage;
     string outputImagePath;
+    bool palettePng; // .png output as indexed color built from the leaf colors
     string gifOutputPath;
+    string streamOutputPath; // native quadtree stream (.qtc), empty = none
+    bool progressiveStream;  // breadth-first .qtc layout (previews from any prefix)
+    int streamIndexLevels;   // pre-order .qtc tiled at this level with an offset index, 0 = none
     bool generateGif;
+    BuildMode buildMode;
+    MetricDispatch metricDispatch;
+    int threadCount; // top-down build threads, 0 = all hardware threads
+    
+    // best-first build budgets, 0 = no limit
+    size_t maxLeaves;
+    size_t maxNodes;
+    size_t maxBytes; // encoded size of the output image
+    
+    bool useErrorTree; // target search cuts one full error tree instead of rebuilding per probe
+    bool useSizeModel; // target search steers on predicted sizes, encoding only to calibrate and verify
     
     CompressionParams() : 
         errorMethod(ErrorMethod::VARIANCE),
         threshold(0.0),
         minBlockSize(1),
         targetCompressionPercentage(0.0),
-        generateGif(false) {}
+        palettePng(false),
+        progressiveStream(false),
+        streamIndexLevels(0),
+        generateGif(false),
+        buildMode(BuildMode::TOP_DOWN),
+        metricDispatch(MetricDispatch::VIRTUAL),
+        threadCount(0),
+        maxLeaves(0),
+        maxNodes(0),
+        maxBytes(0),
+        useErrorTree(true),
+        useSizeModel(true) {}
+    
+    bool hasBuildBudget() const { return maxLeaves > 0 || maxNodes > 0 || maxBytes > 0; }
 };
 
 #endif
\ No newline at end of file
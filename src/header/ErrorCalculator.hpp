@@ -13,93 +13,146 @@
 
 // include header files
 #include "CompressionParams.hpp"
+#include "ImageBuffer.hpp"
+#include "ErrorKernels.hpp"
+#include "IntegralImage.hpp"
+#include "MinMaxPyramid.hpp"
+#include "HistogramPyramid.hpp"
 #include "Pixel.hpp"
 
 // namespace
 using namespace std;
 
 
+// Everything the builder needs from one block, gathered in a single traversal
+struct RegionStats {
+    Pixel meanColor;     // truncated per-channel mean (leaf color)
+    double error;        // metric value compared against the threshold
+    uint64_t pixelCount;
+};
+
+
 class ErrorCalculator {
     public:
         virtual ~ErrorCalculator() = default; // Dtor
-        virtual double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) = 0;
+        virtual double calculateError(const ImageView& image, int x, int y, int width, int height) = 0;
+        
+        // Mean color and error of a block; metrics override it to share their sweep
+        virtual RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height);
+        static Pixel meanColor(const ChannelMoments& moments);
         
         // Factory method to create appropriate error calculator
         static unique_ptr<ErrorCalculator> create(ErrorMethod method);
         
+        // Calls visitor once with the concrete (final) metric type, so templated callers
+        // inline its calls; unknown calculators are passed as the base class
+        template <typename Visitor>
+        static auto dispatch(ErrorCalculator& calculator, Visitor&& visitor) -> decltype(visitor(calculator));
+        
+        // Summed-area tables (owned by the caller, built once per image)
+        virtual bool requiresIntegralImage() const { return false; }
+        void setIntegralImage(const IntegralImage* integral) { integralImage = integral; }
+        
+        // Min/max pyramid over the quadtree grid (owned by the caller, built once per image)
+        virtual bool requiresMinMaxPyramid() const { return false; }
+        void setMinMaxPyramid(const MinMaxPyramid* pyramid) { minMaxPyramid = pyramid; }
+        
+        // Histogram pyramid over the coarse quadtree levels (owned by the caller)
+        virtual bool requiresHistogramPyramid() const { return false; }
+        void setHistogramPyramid(const HistogramPyramid* pyramid) { histogramPyramid = pyramid; }
+        
+        // Bottom-up builds, only for metrics whose statistics merge exactly
+        virtual bool supportsStatsMerging() const { return false; }
+        virtual double calculateErrorFromStats(const BlockStats& stats) const;
+        
     protected:
+        const IntegralImage* integralImage = nullptr;
+        const MinMaxPyramid* minMaxPyramid = nullptr;
+        const HistogramPyramid* histogramPyramid = nullptr;
+        
         // Helper method to validate region bounds
-        bool isValidRegion(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) const;
+        bool isValidRegion(const ImageView& image, int x, int y, int width, int height) const;
+        
+        // Block moments through the summed-area tables when available, else one kernel sweep
+        void regionMoments(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out) const;
 };
 
 
 
 // Variance
-class VarianceErrorCalculator : public ErrorCalculator {
+class VarianceErrorCalculator final : public ErrorCalculator {
     public:
         // Method for calculating error using variance
-        double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) override;
-        
-    private:
-        // Helper method to calculate variance for each rgb channel
-        double calculateVarianceForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel);
+        double calculateError(const ImageView& image, int x, int y, int width, int height) override;
+        RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height) override;
+        bool requiresIntegralImage() const override { return true; }
+        bool supportsStatsMerging() const override { return true; }
+        double calculateErrorFromStats(const BlockStats& stats) const override;
 };
 
 
 
 // Mean Absolute Deviation (MAD)
-class MADErrorCalculator : public ErrorCalculator {
+class MADErrorCalculator final : public ErrorCalculator {
     public:
         // Method for calculating error using MAD
-        double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) override;
-        
-    private:
-        // Helper method to calculate MAD for each rgb channel
-        double calculateMADForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel);
+        double calculateError(const ImageView& image, int x, int y, int width, int height) override;
+        RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height) override;
 };
 
 
 
 // Max Pixel Difference
-class MaxPixelDifferenceCalculator : public ErrorCalculator {
+class MaxPixelDifferenceCalculator final : public ErrorCalculator {
     public:
         // Method for calculating error using max pixel difference
-        double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) override;
-        
-    private:
-        // Helper method to calculate max pixel difference for each rgb channel
-        double calculateMaxDiffForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel);
+        double calculateError(const ImageView& image, int x, int y, int width, int height) override;
+        RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height) override;
+        bool requiresMinMaxPyramid() const override { return true; }
+        bool supportsStatsMerging() const override { return true; }
+        double calculateErrorFromStats(const BlockStats& stats) const override;
 };
 
 
 
 // Entropy
-class EntropyCalculator : public ErrorCalculator {
+class EntropyCalculator final : public ErrorCalculator {
     public:
         // Method for calculating error using entropy
-        double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) override;
-        
-    private:
-        // Helper method to calculate entropy for each rgb channel
-        double calculateEntropyForChannel(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height, int channel);
+        double calculateError(const ImageView& image, int x, int y, int width, int height) override;
+        RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height) override;
+        bool requiresHistogramPyramid() const override { return true; }
 };
 
 
 
 // Structural Similarity Index (SSIM) - Bonus
-class SSIMCalculator : public ErrorCalculator {
+class SSIMCalculator final : public ErrorCalculator {
     public:
         // Method for calculating error using SSIM
-        double calculateError(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height) override;
+        double calculateError(const ImageView& image, int x, int y, int width, int height) override;
+        RegionStats calculateRegionStats(const ImageView& image, int x, int y, int width, int height) override;
+        bool requiresIntegralImage() const override { return true; }
+        bool supportsStatsMerging() const override { return true; }
+        double calculateErrorFromStats(const BlockStats& stats) const override;
         
     private:
-        // Helper method to calculate SSIM for each rgb channel
-        double calculateSSIMForChannel(
-            const vector<vector<Pixel>>& originalBlock,
-            const vector<vector<Pixel>>& compressedBlock,
-            int x, int y, int width, int height, int channel);
-            
-        Pixel calculateAverageColor(const vector<vector<Pixel>>& pixels, int x, int y, int width, int height);
+        // Closed form against a flat block of the (truncated) mean color, only mean and variance are needed
+        static double calculateSSIMFromMoments(uint64_t count, uint64_t sum, uint64_t sumSq);
+        static double calculateErrorFromMoments(const ChannelMoments& moments);
     };
 
+
+
+// one dynamic_cast chain per call, the visitor body is instantiated per metric
+template <typename Visitor>
+auto ErrorCalculator::dispatch(ErrorCalculator& calculator, Visitor&& visitor) -> decltype(visitor(calculator)) {
+    if (auto* metric = dynamic_cast<VarianceErrorCalculator*>(&calculator)) return visitor(*metric);
+    if (auto* metric = dynamic_cast<MADErrorCalculator*>(&calculator)) return visitor(*metric);
+    if (auto* metric = dynamic_cast<MaxPixelDifferenceCalculator*>(&calculator)) return visitor(*metric);
+    if (auto* metric = dynamic_cast<EntropyCalculator*>(&calculator)) return visitor(*metric);
+    if (auto* metric = dynamic_cast<SSIMCalculator*>(&calculator)) return visitor(*metric);
+    return visitor(calculator);
+}
+
 #endif
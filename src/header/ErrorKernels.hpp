@@ -0,0 +1,91 @@
+#ifndef _ERROR_KERNELS_HPP
+#define _ERROR_KERNELS_HPP
+
+
+// include lib files
+#include <cstdint>
+#include <string>
+
+// include header file
+#include "ImageBuffer.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Per-channel statistics produced by a single sweep over a block (index 0 = r, 1 = g, 2 = b)
+struct ChannelMoments {
+    uint64_t count;
+    uint64_t sum[3];
+    uint64_t sumSq[3];
+};
+
+struct ChannelRange {
+    unsigned char minValue[3];
+    unsigned char maxValue[3];
+};
+
+// Count and sum of the values strictly above a per-channel threshold
+struct ChannelTail {
+    uint64_t count[3];
+    uint64_t sum[3];
+};
+
+struct ChannelHistogram {
+    uint32_t bins[3][256];
+};
+
+// Block summary whose parts combine exactly, so parents can be merged from their children
+struct BlockStats {
+    ChannelMoments moments;
+    ChannelRange range;
+    
+    void merge(const BlockStats& other) {
+        moments.count += other.moments.count;
+        for (int c = 0; c < 3; ++c) {
+            moments.sum[c] += other.moments.sum[c];
+            moments.sumSq[c] += other.moments.sumSq[c];
+            range.minValue[c] = range.minValue[c] < other.range.minValue[c] ? range.minValue[c] : other.range.minValue[c];
+            range.maxValue[c] = range.maxValue[c] > other.range.maxValue[c] ? range.maxValue[c] : other.range.maxValue[c];
+        }
+    }
+};
+
+
+// Fused rgb block kernels (SIMD variant picked once from the cpu features)
+class ErrorKernels {
+    public:
+        enum class InstructionSet {
+            SCALAR = 0,
+            SSE2 = 1,
+            AVX2 = 2
+        };
+        
+        // Block sweeps, every variant returns exactly the same integers
+        static void blockMoments(const ImageView& image, int x, int y, int width, int height, ChannelMoments& out);
+        static void blockRange(const ImageView& image, int x, int y, int width, int height, ChannelRange& out);
+        static void blockTail(const ImageView& image, int x, int y, int width, int height, const int thresholds[3], ChannelTail& out);
+        static void blockHistogram(const ImageView& image, int x, int y, int width, int height, ChannelHistogram& out);
+        static void blockStats(const ImageView& image, int x, int y, int width, int height, BlockStats& out);
+        static void blockEntropy(const ImageView& image, int x, int y, int width, int height, double out[3], uint64_t sum[3]);
+        
+        // In-place bgr <-> rgb swap of count packed pixels (decoder rows become Pixel rows)
+        static void swapRedBlue(unsigned char* bytes, int count);
+        
+        // Metric formulas on top of the gathered statistics
+        static double variance(uint64_t count, uint64_t sum, uint64_t sumSq);
+        static double meanAbsoluteDeviation(uint64_t count, uint64_t sum, uint64_t tailCount, uint64_t tailSum);
+        static double entropy(const uint32_t bins[256], uint64_t count);
+        
+        // Dispatch control (QUADTREE_SIMD=scalar|sse2|avx2 overrides the detection)
+        static InstructionSet getInstructionSet();
+        static void setInstructionSet(InstructionSet set);
+        static string getInstructionSetName();
+        
+    private:
+        static InstructionSet detectInstructionSet();
+        static bool isSupported(InstructionSet set);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef _ERROR_TREE_HPP
+#define _ERROR_TREE_HPP
+
+
+// include lib files
+#include <cstdint>
+#include <vector>
+
+// include header files
+#include "QuadTree.hpp"
+#include "ImageBuffer.hpp"
+#include "ErrorCalculator.hpp"
+#include "SizePredictor.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Threshold-independent quadtree: every block is split down to the minimum block size and
+// keeps its error, so the top-down cut for any threshold is read back without the pixels.
+// A block is split by the top-down build iff its error and the errors of all its
+// ancestors are above the threshold, i.e. iff the smallest error on its path (its reach)
+// is. Sorting the reaches of the splittable blocks answers leaf counts by binary search.
+class ErrorTree {
+    public:
+        ErrorTree(); // Ctor
+        ~ErrorTree() = default; // Dtor
+        
+        // Full build, same region stats and split rule as the top-down build
+        void build(ErrorCalculator& calculator, const ImageView& image, int minBlockSize);
+        void clear();
+        
+        // Cut for a threshold: identical arena to a sequential top-down build
+        void extract(double threshold, QuadTree& tree) const;
+        int countLeaves(double threshold) const;
+        TreeFeatures cutFeatures(double threshold) const; // O(log n), without extracting
+        
+        // Upper bound on the nodes a full build allocates, to decide if it fits in memory
+        static size_t estimateNodeCount(int width, int height, int minBlockSize);
+        
+        // Getters
+        bool empty() const { return full.empty(); }
+        size_t size() const { return full.size(); }
+    
+    private:
+        QuadTree full;
+        vector<double> errors;  // per arena index
+        vector<double> reaches; // sorted, one per splittable block
+        vector<uint64_t> rowRunsAbove;    // suffix sums of the block heights over reaches
+        vector<uint64_t> columnRunsAbove; // suffix sums of the block widths
+        
+        struct Split {
+            double reach;
+            int width;
+            int height;
+        };
+        vector<Split> splits; // only while building
+        
+        void buildNode(ErrorCalculator& calculator, const ImageView& image, int minBlockSize, const QuadTreeNode& node, double parentReach);
+        void extractNode(double threshold, const QuadTreeNode& source, QuadTree& tree, const QuadTreeNode& target) const;
+};
+
+#endif
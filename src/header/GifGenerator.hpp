@@ -28,26 +28,19 @@ class GifGenerator {
         GifGenerator(); // Ctor
         ~GifGenerator(); // Dtor
         
-        // Generate GIF from QuadTree
-        bool generateGif(const QuadTree& quadTree, const string& outputPath);
-        
+        // Generate GIF from QuadTree; frames that show every leaf reuse finalImage
+        // (the rendered output) when it is given
+        bool generateGif(const QuadTree& quadTree, const string& outputPath, const cv::Mat& finalImage = cv::Mat());
+    
     private:
-        // Internal frame storage
-        struct Frame {
-            vector<vector<Pixel>> pixels;
-            int width;
-            int height;
-        };
-        
-        // Helper methods
-        void renderTreeAtDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, int targetDepth);
-        void renderTreeAtDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, int targetDepth, int currentDepth);
-        void renderPartialDepth(Frame& frame, const shared_ptr<QuadTreeNode>& node, 
+        // Helper methods (frames are BGR, like the output image)
+        void renderTreeAtDepth(cv::Mat& frame, const QuadTree& tree, int targetDepth);
+        void renderTreeAtDepth(cv::Mat& frame, const QuadTree& tree, const QuadTreeNode& node, int targetDepth, int currentDepth);
+        void renderPartialDepth(cv::Mat& frame, const QuadTree& tree, const QuadTreeNode& node, 
                             int baseDepth, int nextDepth, float progress);
-        void drawNode(Frame& frame, const shared_ptr<QuadTreeNode>& node);
-        int getNodeDepth(const shared_ptr<QuadTreeNode>& node);
+        void drawNode(cv::Mat& frame, const QuadTreeNode& node);
+        int getNodeDepth(const QuadTree& tree, const QuadTreeNode& node);
         
-        vector<Frame> frames;
         int imageWidth;
         int imageHeight;
 };
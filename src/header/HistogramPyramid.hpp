@@ -0,0 +1,42 @@
+#ifndef _HISTOGRAM_PYRAMID_HPP
+#define _HISTOGRAM_PYRAMID_HPP
+
+
+// include lib files
+#include <vector>
+
+// include header files
+#include "ImageBuffer.hpp"
+#include "ErrorKernels.hpp"
+#include "QuadGrid.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Per-channel 256-bin histograms for the coarse levels of the quadtree split grid.
+// A histogram is 3 KB, so the finest level keeps about a thousand pixels per cell; blocks
+// below it are small enough to be counted directly.
+class HistogramPyramid {
+    public:
+        HistogramPyramid() = default; // Ctor
+        ~HistogramPyramid() = default; // Dtor
+        
+        // Build all levels (O(width * height))
+        void build(const ImageView& image);
+        void clear();
+        
+        // Getters
+        bool isBuilt() const { return grid.isBuilt(); }
+        int getLevelCount() const { return grid.getLevelCount(); }
+        
+        // Cached histogram of a quadtree block, nullptr when the block is not on a stored level
+        const ChannelHistogram* query(int x, int y, int width, int height) const;
+        
+    private:
+        QuadGrid grid;
+        vector<vector<ChannelHistogram>> cells; // per level, row-major 2^d x 2^d
+};
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef _IMAGE_BUFFER_HPP
+#define _IMAGE_BUFFER_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// include header file
+#include "Pixel.hpp"
+
+
+// namespace
+using namespace std;
+
+// rows are reinterpreted as packed Pixel arrays
+static_assert(sizeof(Pixel) == 3, "Pixel must be tightly packed (3 bytes)");
+
+
+// Non-owning, stride-aware view of an rgb image
+class ImageView {
+    public:
+        ImageView(): data(nullptr), width(0), height(0), stride(0) {}
+        ImageView(const unsigned char* data, int width, int height, size_t stride): data(data), width(width), height(height), stride(stride) {}
+        
+        // Getters
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        size_t getStride() const { return stride; } // bytes between two rows
+        bool empty() const { return data == nullptr || width <= 0 || height <= 0; }
+        
+        // Pixel access
+        const Pixel* row(int y) const { return reinterpret_cast<const Pixel*>(data + static_cast<size_t>(y) * stride); }
+        const Pixel& at(int x, int y) const { return row(y)[x]; }
+        const unsigned char* rowBytes(int y) const { return data + static_cast<size_t>(y) * stride; }
+        
+    private:
+        const unsigned char* data;
+        int width;
+        int height;
+        size_t stride;
+};
+
+
+// Owning rgb image in one contiguous allocation with cache-line aligned rows, or rows
+// adopted from elsewhere (a decoded image) that owner keeps alive
+class ImageBuffer {
+    public:
+        ImageBuffer(); // Ctor
+        ImageBuffer(int width, int height, const Pixel& fillColor = Pixel());
+        ImageBuffer(const ImageBuffer& other);
+        ImageBuffer(ImageBuffer&& other) noexcept = default;
+        ImageBuffer& operator=(const ImageBuffer& other);
+        ImageBuffer& operator=(ImageBuffer&& other) noexcept = default;
+        ~ImageBuffer() = default; // Dtor
+        
+        // Storage
+        void allocate(int width, int height);
+        void adopt(unsigned char* data, int width, int height, size_t stride, shared_ptr<void> owner); // no copy, rows must hold rgb Pixels
+        void fill(const Pixel& color);
+        void release();
+        
+        // Getters
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        size_t getStride() const { return stride; }
+        bool empty() const { return width <= 0 || height <= 0; }
+        ImageView view() const { return ImageView(base(), width, height, stride); }
+        
+        // Pixel access
+        Pixel* row(int y) { return reinterpret_cast<Pixel*>(base() + static_cast<size_t>(y) * stride); }
+        const Pixel* row(int y) const { return reinterpret_cast<const Pixel*>(base() + static_cast<size_t>(y) * stride); }
+        Pixel& at(int x, int y) { return row(y)[x]; }
+        const Pixel& at(int x, int y) const { return row(y)[x]; }
+        
+    private:
+        static const size_t ROW_ALIGNMENT = 64;
+        
+        vector<unsigned char> storage; // over-allocated so the first row can be aligned
+        size_t offset;                 // aligned start inside storage
+        unsigned char* external;       // adopted rows, null = storage
+        shared_ptr<void> owner;        // keeps the adopted rows alive
+        int width;
+        int height;
+        size_t stride;
+        
+        unsigned char* base() { return external ? external : storage.data() + offset; }
+        const unsigned char* base() const { return external ? external : storage.data() + offset; }
+};
+
+#endif
@@ -4,12 +4,23 @@
 // include header files
 #include "Pixel.hpp"
 #include "QuadTree.hpp"
+#include "ImageBuffer.hpp"
+#include "IntegralImage.hpp"
+#include "MinMaxPyramid.hpp"
+#include "HistogramPyramid.hpp"
 #include "ErrorCalculator.hpp"
+#include "ErrorTree.hpp"
+#include "SizePredictor.hpp"
+#include "LeafRasterizer.hpp"
+#include "QuadTreeCodec.hpp"
+#include "PalettePngWriter.hpp"
 #include "CompressionParams.hpp"
+#include "WorkStealingPool.hpp"
 
 // include lib files
 #include <cmath>
 #include <mutex>
+#include <queue>
 #include <future>
 #include <limits>
 #include <memory>
@@ -39,6 +50,9 @@ class ImageProcessor {
         QuadTree compressImage();
         bool saveCompressedImage(const string& outputPath);
         bool saveCompressedImageToBuffer(const string& extension, vector<unsigned char>& buffer);
+        bool saveQuadTreeStream(const string& outputPath);
+        bool encodeTree(const QuadTree& tree, const string& extension, vector<unsigned char>& buffer) const;
+        const cv::Mat& getRenderedImage(); // output of the current tree, rendered once per tree version
         size_t calculateTheoricalCompressedSize(const QuadTree& tree) const;
         
         // Getters
@@ -51,23 +65,43 @@ class ImageProcessor {
         CompressionParams params;
         int imageWidth;
         int imageHeight;
-        vector<vector<Pixel>> pixels;
+        ImageBuffer pixels;
+        IntegralImage integralImage;
+        MinMaxPyramid minMaxPyramid;
+        HistogramPyramid histogramPyramid;
         unique_ptr<ErrorCalculator> errorCalculator;
+        unique_ptr<WorkStealingPool> buildPool;
+        ErrorTree errorTree; // only alive during a target search
         size_t originalImageSize;
         size_t compressedImageSize;
         QuadTree quadTree;
+        cv::Mat renderedImage;
+        uint64_t renderedVersion; // quadTree version in renderedImage, 0 = none
         
         // Helper methods
         void adjustMinimumBlockSize();
         size_t getFileSize(const string& filename) const;
         void initializeErrorCalculator();
-        shared_ptr<QuadTreeNode> buildQuadTree(int x, int y, int width, int height, int depth);
-        bool shouldSubdivide(int x, int y, int width, int height, double& error);
-        Pixel calculateAverageColor(int x, int y, int width, int height);
+        static bool encodeImage(const cv::Mat& image, const string& extension, vector<unsigned char>& buffer);
+        bool buildQuadTreeRoot(QuadTree& tree, double threshold);
+        void buildQuadTree(QuadTree& tree, const QuadTreeNode& node, int depth, double threshold);
+        template <typename Metric>
+        void buildQuadTreeWith(Metric& metric, QuadTree& tree, const QuadTreeNode& node, int depth, double threshold);
+        template <typename Metric>
+        void buildQuadTreeParallel(Metric& metric, QuadTree& tree, const QuadTreeNode& node, int depth, double threshold);
+        template <typename Metric>
+        void buildQuadTreeBestFirst(Metric& metric, QuadTree& tree, double threshold);
+        template <typename Metric>
+        bool evaluateBlock(Metric& metric, QuadTree& tree, const QuadTreeNode& node, double threshold, RegionStats& stats) const;
+        bool exceedsBuildBudget(size_t leafCount, size_t nodeCount) const;
+        WorkStealingPool* getBuildPool();
+        void buildQuadTreeBottomUp(QuadTree& tree, const QuadTreeNode& node, int depth, double threshold, BlockStats& stats);
+        bool shouldSubdivide(int x, int y, int width, int height, double threshold, RegionStats& stats);
+        Pixel averageColorFromStats(const BlockStats& stats) const;
         
         // Target compression methods (bonus)
         double findThresholdForTargetCompression(double targetPercentage);
-        double compressWithThreshold(double threshold);
+        bool prepareErrorTree();
         
         // Validator
         bool isValidRegion(int x, int y, int width, int height) const;
@@ -0,0 +1,54 @@
+#ifndef _INTEGRAL_IMAGE_HPP
+#define _INTEGRAL_IMAGE_HPP
+
+
+// include lib files
+#include <cstdint>
+#include <vector>
+
+// include header file
+#include "ImageBuffer.hpp"
+#include "ErrorKernels.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Summed-area tables (per rgb channel) for O(1) block sums
+class IntegralImage {
+    public:
+        IntegralImage(); // Ctor
+        ~IntegralImage() = default; // Dtor
+        
+        // Build the tables from image pixels (O(width * height))
+        void build(const ImageView& image);
+        void clear();
+        
+        // Getters
+        bool isBuilt() const { return !entries.empty(); }
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        
+        // Region queries, all O(1)
+        uint64_t getSum(int x, int y, int w, int h, int channel) const;
+        uint64_t getSumOfSquares(int x, int y, int w, int h, int channel) const;
+        double getVariance(int x, int y, int w, int h, int channel) const;
+        void getMoments(int x, int y, int w, int h, ChannelMoments& out) const;
+        bool covers(int x, int y, int w, int h) const;
+        
+    private:
+        // One table cell, channels interleaved so a corner lookup stays in one cache line
+        struct Entry {
+            uint64_t sum[3];
+            uint64_t sumSq[3];
+        };
+        
+        int width;
+        int height;
+        vector<Entry> entries; // (width + 1) * (height + 1), first row and column are zero
+        
+        size_t index(int x, int y) const { return static_cast<size_t>(y) * (width + 1) + x; }
+};
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef _LEAF_RASTERIZER_HPP
+#define _LEAF_RASTERIZER_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+// include header files
+#include "Pixel.hpp"
+#include "QuadTree.hpp"
+#include "WorkStealingPool.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Paints the leaves of a tree straight into an 8-bit BGR buffer, one row span at a time.
+// Output matches cv::rectangle(FILLED) in depth-first order: the far corner is inclusive,
+// so each leaf also covers the first row and column of its right / lower neighbours and
+// the later leaf wins. The image is cut into horizontal bands that clip the same leaf
+// list in the same order, so bands can be painted on any thread.
+class LeafRasterizer {
+    public:
+        // pool may be null (single band)
+        static void render(const QuadTree& tree, unsigned char* bgr, int width, int height, size_t stride, WorkStealingPool* pool);
+        
+        // Only the viewport (x, y, width, height) of the tree's image, pixels equal to the
+        // same area of a full render; bgr holds the viewport alone
+        static void renderRegion(const QuadTree& tree, int x, int y, int width, int height, unsigned char* bgr, size_t stride, WorkStealingPool* pool);
+        
+        // Same coverage, one byte per pixel: indexOf(leaf color) instead of the color
+        static void renderIndexed(const QuadTree& tree, const function<unsigned char(const Pixel&)>& indexOf, unsigned char* indices, int width, int height, size_t stride, WorkStealingPool* pool);
+    
+    private:
+        struct Span {
+            int x0, y0, x1, y1; // inclusive
+            Pixel color;
+        };
+        
+        struct Viewport {
+            int x, y, width, height;
+        };
+        
+        static bool clipLeaf(const QuadTreeNode& node, int width, int height, const Viewport& view, Span& span);
+        static void collect(const QuadTree& tree, const Viewport& view, vector<Span>& spans);
+        static void renderSpan(const Span& span, unsigned char* bgr, size_t stride, int firstRow, int lastRow);
+        static void renderIndexSpan(const Span& span, unsigned char index, unsigned char* indices, size_t stride, int firstRow, int lastRow);
+        
+        template <typename Paint>
+        static void paintBands(const QuadTree& tree, const Viewport& view, WorkStealingPool* pool, const Paint& paint);
+};
+
+#endif
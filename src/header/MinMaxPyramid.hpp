@@ -0,0 +1,41 @@
+#ifndef _MIN_MAX_PYRAMID_HPP
+#define _MIN_MAX_PYRAMID_HPP
+
+
+// include lib files
+#include <vector>
+
+// include header files
+#include "ImageBuffer.hpp"
+#include "ErrorKernels.hpp"
+#include "QuadGrid.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Per-channel min/max for every block of the quadtree split grid, built by scanning the
+// finest level and merging 2x2 cells upwards.
+class MinMaxPyramid {
+    public:
+        MinMaxPyramid() = default; // Ctor
+        ~MinMaxPyramid() = default; // Dtor
+        
+        // Build all levels (O(width * height))
+        void build(const ImageView& image);
+        void clear();
+        
+        // Getters
+        bool isBuilt() const { return grid.isBuilt(); }
+        int getLevelCount() const { return grid.getLevelCount(); }
+        
+        // O(1) lookup of a quadtree block, false when the block is not on a stored level
+        bool query(int x, int y, int width, int height, ChannelRange& out) const;
+        
+    private:
+        QuadGrid grid;
+        vector<vector<ChannelRange>> cells; // per level, row-major 2^d x 2^d
+};
+
+#endif
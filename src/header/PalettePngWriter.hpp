@@ -0,0 +1,60 @@
+#ifndef _PALETTE_PNG_WRITER_HPP
+#define _PALETTE_PNG_WRITER_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+// include header files
+#include "Pixel.hpp"
+#include "QuadTree.hpp"
+#include "WorkStealingPool.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Indexed-color PNG straight from the leaves. Every pixel shows a leaf color and trees
+// rarely hold more than a few thousand of them, so one palette index per pixel (or fewer
+// bits for small palettes) replaces 24-bit BGR. Up to MAX_COLORS leaf colors the palette is
+// exact and the image matches the BGR render; beyond that the colors are cut down by
+// area-weighted median cut.
+class PalettePngWriter {
+    public:
+        static const size_t MAX_COLORS = 256;
+        
+        // pool may be null; colors is the palette size, exact false when it was quantized
+        static bool encode(const QuadTree& tree, vector<unsigned char>& out, WorkStealingPool* pool, size_t& colors, bool& exact);
+        static bool writeFile(const string& path, const QuadTree& tree, WorkStealingPool* pool, size_t& bytesWritten, size_t& colors, bool& exact);
+    
+    private:
+        // leaf color packed as 0xRRGGBB and the pixels it covers
+        struct ColorWeight {
+            uint32_t key;
+            uint64_t weight;
+        };
+        
+        // colors[begin, end) of one median cut box
+        struct Box {
+            size_t begin;
+            size_t end;
+            int channel; // widest channel, as a shift of the key
+            int range;   // its extent, 0 = nothing left to split
+        };
+        
+        static void collectColors(const QuadTree& tree, vector<ColorWeight>& colors);
+        static void buildPalette(vector<ColorWeight>& colors, vector<Pixel>& palette, unordered_map<uint32_t, unsigned char>& indexOf);
+        static void measureBox(const vector<ColorWeight>& colors, Box& box);
+        static Pixel meanColor(const vector<ColorWeight>& colors, const Box& box);
+        
+        static int bitDepth(size_t colors);
+        static void packRows(vector<unsigned char>& rows, int width, int height, int depth);
+        static void writeChunk(const char* type, const unsigned char* data, size_t size, vector<unsigned char>& out);
+};
+
+#endif
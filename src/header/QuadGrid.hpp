@@ -0,0 +1,67 @@
+#ifndef _QUAD_GRID_HPP
+#define _QUAD_GRID_HPP
+
+
+// include lib files
+#include <cstdint>
+#include <vector>
+
+
+// namespace
+using namespace std;
+
+
+// Block layout of the quadtree split, level by level.
+// Splitting a block into half and remainder only depends on its width (or height), so all
+// blocks at depth d form a 2^d x 2^d grid of x-intervals times y-intervals. Per-block caches
+// (min/max, histograms) store one cell per grid position and use this to find it.
+class QuadGrid {
+    public:
+        QuadGrid(); // Ctor
+        ~QuadGrid() = default; // Dtor
+        
+        // Levels 0..levelCount-1 for an image of the given size
+        void build(int width, int height, int levelCount);
+        void clear();
+        
+        // Deepest level whose cells still hold about minPixelsPerCell pixels
+        static int finestLevelFor(int width, int height, uint64_t minPixelsPerCell);
+        
+        // Getters
+        bool isBuilt() const { return !levels.empty(); }
+        int getLevelCount() const { return static_cast<int>(levels.size()); }
+        size_t getSide(int level) const { return levels[level].xAxis.start.size(); }
+        size_t getCellCount(int level) const { return getSide(level) * getSide(level); }
+        int getX(int level, size_t cx) const { return levels[level].xAxis.start[cx]; }
+        int getY(int level, size_t cy) const { return levels[level].yAxis.start[cy]; }
+        int getWidth(int level, size_t cx) const { return levels[level].xAxis.length[cx]; }
+        int getHeight(int level, size_t cy) const { return levels[level].yAxis.length[cy]; }
+        
+        // Row-major cell index of the 4 children (level + 1) of a cell
+        size_t childCell(int level, size_t cell, int quadrant) const;
+        
+        // O(1) lookup of a quadtree block, false when the block is not on a stored level
+        bool locate(int x, int y, int w, int h, int& level, size_t& cell) const;
+        
+    private:
+        // Split of one axis at one depth
+        struct AxisLevel {
+            vector<int> start;       // interval start, 2^d entries
+            vector<int> length;      // interval length (may be 0)
+            vector<int32_t> indexAt; // coordinate -> index of the non-empty interval starting there, -1 otherwise
+        };
+        
+        struct Level {
+            AxisLevel xAxis;
+            AxisLevel yAxis;
+        };
+        
+        int width;
+        int height;
+        vector<Level> levels;
+        
+        static void splitAxis(const AxisLevel& parent, AxisLevel& child, int extent);
+        bool findCell(int level, int x, int y, int w, int h, size_t& cell) const;
+};
+
+#endif
@@ -3,7 +3,8 @@
 
 
 // include lib files
-#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <iostream>
 #include <cassert>
@@ -17,9 +18,29 @@
 using namespace std;
 
 
-// Node
+// Stored node (8 bytes): geometry is implicit, it follows from the parent block and the
+// quadrant through the half/remainder split of buildQuadTree
+struct PackedNode {
+    static const uint32_t NO_CHILD = 0xFFFFFFFFu;
+    static const uint8_t LEAF = 1;
+    static const int LEVEL_SHIFT = 1; // remaining flag bits hold the depth (root = 0)
+    
+    Pixel color;         // average color of the block
+    uint8_t flags;       // LEAF | level << LEVEL_SHIFT
+    uint32_t firstChild; // index of the 4-child block (tl, tr, bl, br), NO_CHILD for leaves
+    
+    bool isLeaf() const { return (flags & LEAF) != 0; }
+    int getLevel() const { return flags >> LEVEL_SHIFT; }
+};
+
+static_assert(sizeof(PackedNode) == 8, "PackedNode must stay 8 bytes");
+
+
+// Node as seen during traversal: the stored node plus its reconstructed geometry
 class QuadTreeNode {
     public:
+        static const uint32_t NO_CHILD = PackedNode::NO_CHILD;
+        
         QuadTreeNode(int x, int y, int width, int height); //Ctor
         ~QuadTreeNode() = default; // Dtor
         
@@ -28,47 +49,98 @@ class QuadTreeNode {
         int getY() const { return y; }
         int getWidth() const { return width; }
         int getHeight() const { return height; }
-        bool isLeaf() const { return children.empty(); }
+        bool isLeaf() const { return firstChild == NO_CHILD; }
         const Pixel& getColor() const { return color; }
-        const vector<shared_ptr<QuadTreeNode>>& getChildren() const { return children; }
-        
-        // Setters
-        void setColor(const Pixel& newColor) { color = newColor; }
-        void addChild(shared_ptr<QuadTreeNode> child);
+        uint32_t getIndex() const { return index; }
+        uint32_t getFirstChild() const { return firstChild; } // children are firstChild .. firstChild + 3
         
     private:
+        friend class QuadTree;
+        
         int x, y;              // Top-left corner
         int width, height;     // Dimensions of the node
         Pixel color;           // color of the node (average color for leaf nodes)
-        vector<shared_ptr<QuadTreeNode>> children; // Child nodes
+        uint32_t index;        // position in the arena
+        uint32_t firstChild;   // snapshot of the stored child index
 };
 
 
-// QuadTree
+// QuadTree (contiguous arena of packed nodes, root at index 0)
 class QuadTree {
     public:
         QuadTree();
         ~QuadTree() = default;
         
+        // Arena building
+        void reset(int width, int height); // drop all nodes, create the root
+        void resetBlock(int x, int y, int width, int height, int level); // root is a block deeper in a tree (fragment)
+        void reserve(size_t nodeCount);
+        uint32_t split(uint32_t index);    // append the 4 children of a leaf, returns the first index
+        void collapse(uint32_t index);     // drop the children again (must be the most recently built subtree)
+        void setColor(uint32_t index, const Pixel& color) { nodes[index].color = color; modified = true; }
+        void attach(uint32_t index, const QuadTree& fragment); // append a fragment built for the leaf at index
+        
+        // Traversal, geometry rebuilt from the parent
+        QuadTreeNode getRoot() const;
+        QuadTreeNode getChild(const QuadTreeNode& node, int quadrant) const;
+        
         // Getters
-        shared_ptr<QuadTreeNode> getRoot() const { return root; }
-        int getDepth() const { return depth; }
-        int getNodeCount() const { return nodeCount; }
+        bool empty() const { return nodes.empty(); }
+        size_t size() const { return nodes.size(); }
+        int getWidth() const { return width; }
+        int getHeight() const { return height; }
+        const PackedNode& getPacked(uint32_t index) const { return nodes[index]; }
+        const vector<PackedNode>& getNodes() const { return nodes; }
         
-        // Setters
-        void setRoot(shared_ptr<QuadTreeNode> newRoot);
+        // Changes after any modification, copies keep it (renders can be cached against it).
+        // Assigned on first read, so one tree must not be asked from several threads at once
+        uint64_t getVersion() const;
         
-        // Depth and node count calculation
-        void calculateDepthAndNodeCount();
+        // Statistics kept up to date by split / collapse, all O(1)
+        int getDepth() const { return static_cast<int>(levelCounts.size()); } // levels, a lone root is 1
+        int getNodeCount() const { return static_cast<int>(nodes.size()); }
+        int getLeafCount() const { return leafCount; }
+        int getNodeCountAtDepth(int level) const;
+        const vector<int>& getNodeCountsPerDepth() const { return levelCounts; }
+        
+        // Visit leaves in depth-first order (tl, tr, bl, br), iterative
+        template <typename Visitor>
+        void forEachLeaf(Visitor&& visitor) const;
         
     private:
-        shared_ptr<QuadTreeNode> root;
-        int depth;
-        int nodeCount;
+        vector<PackedNode> nodes;
+        int rootX;
+        int rootY;
+        int width;
+        int height;
+        vector<int> levelCounts; // nodes per depth
+        int leafCount;
+        mutable uint64_t version;
+        mutable bool modified;
+        static atomic<uint64_t> versionCounter;
         
-        // Method
-        int calculateDepth(shared_ptr<QuadTreeNode> node);
-        int countNodes(shared_ptr<QuadTreeNode> node);
+        QuadTreeNode makeNode(uint32_t index, int x, int y, int w, int h) const;
 };
 
-#endif
\ No newline at end of file
+
+template <typename Visitor>
+void QuadTree::forEachLeaf(Visitor&& visitor) const {
+    if (nodes.empty()) {
+        return;
+    }
+    
+    vector<QuadTreeNode> stack(1, getRoot());
+    while (!stack.empty()) {
+        QuadTreeNode node = stack.back();
+        stack.pop_back();
+        if (node.isLeaf()) {
+            visitor(node);
+        } else {
+            for (int k = 3; k >= 0; --k) {
+                stack.push_back(getChild(node, k));
+            }
+        }
+    }
+}
+
+#endif
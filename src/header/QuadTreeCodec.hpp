@@ -0,0 +1,175 @@
+#ifndef _QUADTREE_CODEC_HPP
+#define _QUADTREE_CODEC_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// include header files
+#include "Pixel.hpp"
+#include "QuadTree.hpp"
+#include "RangeCoder.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// Native quadtree stream (.qtc): the tree itself instead of a rendered image.
+//
+//   "QTC" version layout   5 bytes
+//   width height           varints
+//   splitArea              varint, blocks whose quarter is smaller never split (no flag stored)
+//   nodeCount              varint
+//   payload                range coded
+//
+// Pre-order layout: one range coded payload to the end of the stream, walking the tree
+// depth first (tl, tr, bl, br). A split flag for every block that could split, then for
+// each leaf its color, predicted from the already decoded leaves to the left and above
+// (median predictor). Green is coded first and its residual is taken off the red and
+// blue ones. Decoding rebuilds the arena in the order the top-down build appends it,
+// internal blocks get the area-weighted mean color of their children.
+//
+// Breadth-first layout: the tree level by level, every block with its own (average)
+// color predicted from its parent, so any prefix renders as a coarser image. The payload
+// is cut into chunks (varint length + separately flushed range coder) that hold whole
+// 4-child families, a reader can stop at any chunk boundary.
+//
+// Indexed layout: pre-order, cut at level K into tiles that decode on their own.
+//
+//   K topSize indexSize    varints
+//   top                    pre-order above level K, level K blocks with flag and color
+//   index                  varint count, one varint segment length per split tile
+//   segments               per split tile (pre-order), children of the tile with fresh
+//                          models, colors predicted inside the tile only
+//
+// A region decode reads the top and the index, then seeks to the tiles that intersect
+// the region. Tiles outside keep their average color.
+class QuadTreeCodec {
+    public:
+        static const unsigned char VERSION = 1;
+        
+        static const int MAX_INDEX_LEVELS = 10;
+        
+        enum class Layout : unsigned char {
+            PRE_ORDER = 0,     // smallest, decoded as a whole
+            BREADTH_FIRST = 1, // progressive, internal colors included
+            INDEXED = 2        // pre-order tiles below indexLevels, region decode
+        };
+        
+        static bool encode(const QuadTree& tree, vector<unsigned char>& out, Layout layout = Layout::PRE_ORDER, int indexLevels = 0);
+        static bool decode(const unsigned char* data, size_t size, QuadTree& tree); // whole stream, any layout
+        
+        // Indexed streams: only the tiles that intersect the region, other layouts are decoded whole
+        static bool decodeRegion(const unsigned char* data, size_t size, QuadTree& tree, int x, int y, int width, int height);
+        
+        // Breadth-first streams only: decodes the chunks that end within byteBudget bytes and
+        // the levels above depthLimit (levels, the root alone is 1), 0 = no limit. A short
+        // buffer counts as a budget. Blocks whose children were not reached stay leaves.
+        static bool decodePartial(const unsigned char* data, size_t size, QuadTree& tree, size_t byteBudget, int depthLimit);
+        
+        static bool writeFile(const string& path, const QuadTree& tree, size_t& bytesWritten, Layout layout = Layout::PRE_ORDER, int indexLevels = 0);
+        static bool readFile(const string& path, QuadTree& tree);
+        static bool readFilePartial(const string& path, QuadTree& tree, size_t byteBudget, int depthLimit); // reads no more than the budget
+        static bool readFileRegion(const string& path, QuadTree& tree, int x, int y, int width, int height); // reads top, index and the tiles needed
+    
+    private:
+        // families per breadth-first chunk
+        static const size_t CHUNK_FAMILIES = 512;
+        
+        struct Header {
+            Layout layout;
+            int width;
+            int height;
+            uint64_t splitArea;
+            uint64_t nodeCount;
+            int indexLevels; // indexed layout only, else 0
+            uint64_t topSize;
+            uint64_t indexSize;
+        };
+        
+        struct Region {
+            int x, y, width, height;
+        };
+        
+        // Segment table of an indexed stream, offsets from the stream start
+        struct TileIndex {
+            vector<uint64_t> offsets;
+            vector<uint64_t> sizes;
+        };
+        
+        // Pre-order models and the leaf color predictor, shared by encoder and decoder
+        class Models {
+            public:
+                Models(int x, int y, int width, int height, const Pixel& start); // Ctor, predicts inside the block only
+                
+                BitModel* splitModel(int level, int previousSplit);
+                
+                // Prediction for the leaf at (x, y), context says whether its neighbourhood is flat
+                Pixel predict(int x, int y, int& context) const;
+                BitModel* colorModels(int context) { return colors[context][0]; }
+                void update(const QuadTreeNode& leaf, const Pixel& color);
+            
+            private:
+                static const int SPLIT_LEVELS = 16;
+                BitModel splits[SPLIT_LEVELS][2];
+                BitModel colors[2][3][256];
+                int originX;
+                int originY;
+                vector<Pixel> above; // last leaf color per column
+                vector<Pixel> left;  // last leaf color per row
+                Pixel previous;
+        };
+        
+        // Breadth-first models, residuals shrink with depth so every level has its own
+        class LevelModels {
+            public:
+                LevelModels(); // Ctor
+                
+                BitModel* splitModel(int level, int splitSiblings);
+                BitModel* colorModels(int level, int quadrant);
+            
+            private:
+                static const int LEVELS = 16;
+                BitModel splits[LEVELS][4];
+                BitModel colors[LEVELS][2][3][256]; // first three children, last child
+        };
+        
+        static uint64_t splitArea(const QuadTreeNode& node) {
+            return static_cast<uint64_t>(node.getWidth() / 2) * static_cast<uint64_t>(node.getHeight() / 2);
+        }
+        
+        static void writeHeader(const Header& header, vector<unsigned char>& out);
+        static bool readHeader(const unsigned char* data, size_t size, Header& header, size_t& offset);
+        static bool readChunk(const unsigned char* data, size_t end, size_t& offset, const unsigned char*& chunk, size_t& chunkSize);
+        
+        // color residuals, models holds the green, red and blue trees (256 each)
+        static void encodeColor(const Pixel& prediction, const Pixel& color, BitModel* models, RangeEncoder& encoder);
+        static Pixel decodeColor(const Pixel& prediction, BitModel* models, RangeDecoder& decoder);
+        
+        // pre-order layout, with tiles set blocks at header.indexLevels are coded as tiles
+        static void encodeNode(const QuadTree& tree, const QuadTreeNode& node, const Header& header, int previousSplit, Models& models, RangeEncoder& encoder, vector<QuadTreeNode>* tiles);
+        static void encodeChildren(const QuadTree& tree, const QuadTreeNode& node, const Header& header, Models& models, RangeEncoder& encoder, vector<QuadTreeNode>* tiles);
+        static bool decodeNode(QuadTree& tree, const QuadTreeNode& node, const Header& header, int previousSplit, Models& models, RangeDecoder& decoder, vector<QuadTreeNode>* tiles);
+        static bool decodeChildren(QuadTree& tree, const QuadTreeNode& node, const Header& header, Models& models, RangeDecoder& decoder, vector<QuadTreeNode>* tiles);
+        static Pixel meanOfChildren(const QuadTree& tree, const QuadTreeNode& node);
+        
+        // indexed layout
+        static void encodeIndexed(const QuadTree& tree, Header& header, vector<unsigned char>& out);
+        static bool decodeTop(const unsigned char* data, size_t offset, const Header& header, QuadTree& tree, vector<QuadTreeNode>& tiles);
+        static bool readIndex(const unsigned char* data, size_t offset, const Header& header, size_t tileCount, TileIndex& index);
+        static bool decodeTile(const unsigned char* data, size_t size, const Header& header, QuadTree& tree, const QuadTreeNode& tile);
+        static bool decodeIndexed(const unsigned char* data, size_t size, size_t offset, const Header& header, const Region* region, QuadTree& tree);
+        static bool intersects(const QuadTreeNode& node, const Region* region);
+        
+        // breadth-first layout
+        static void encodeLevels(const QuadTree& tree, const Header& header, vector<unsigned char>& out);
+        static void encodeFamily(const QuadTree& tree, const QuadTreeNode& parent, const Header& header, LevelModels& models, RangeEncoder& encoder, vector<QuadTreeNode>& next);
+        static bool decodeLevels(const unsigned char* data, size_t end, size_t offset, const Header& header, int depthLimit, QuadTree& tree);
+        static bool decodeFamily(QuadTree& tree, const QuadTreeNode& parent, const Header& header, LevelModels& models, RangeDecoder& decoder, vector<QuadTreeNode>& next);
+};
+
+#endif
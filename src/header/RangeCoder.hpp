@@ -0,0 +1,142 @@
+#ifndef _RANGE_CODER_HPP
+#define _RANGE_CODER_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+// namespace
+using namespace std;
+
+
+// Adaptive binary range coder (LZMA style). Every coded bit has its own probability
+// model, an 11-bit estimate of the chance of a 0 that moves 1/16 of the way towards
+// each coded bit, so skewed flags and small residuals cost a fraction of a bit.
+typedef uint16_t BitModel;
+
+static const int BIT_MODEL_BITS = 11;
+static const BitModel BIT_MODEL_INIT = 1 << (BIT_MODEL_BITS - 1);
+static const int BIT_MODEL_SHIFT = 4;
+static const uint32_t RANGE_TOP = 1u << 24;
+
+
+class RangeEncoder {
+    public:
+        explicit RangeEncoder(vector<unsigned char>& out): out(out), low(0), range(0xFFFFFFFFu), cache(0), cacheSize(1) {} // Ctor
+        
+        void encodeBit(BitModel& model, int bit) {
+            uint32_t bound = (range >> BIT_MODEL_BITS) * model;
+            if (bit == 0) {
+                range = bound;
+                model += ((1 << BIT_MODEL_BITS) - model) >> BIT_MODEL_SHIFT;
+            } else {
+                low += bound;
+                range -= bound;
+                model -= model >> BIT_MODEL_SHIFT;
+            }
+            while (range < RANGE_TOP) {
+                range <<= 8;
+                shiftLow();
+            }
+        }
+        
+        // value of the given width, most significant bit first, models[1 .. 2^bits - 1]
+        void encodeTree(BitModel* models, int bits, uint32_t value) {
+            uint32_t context = 1;
+            for (int i = bits - 1; i >= 0; --i) {
+                int bit = (value >> i) & 1;
+                encodeBit(models[context], bit);
+                context = (context << 1) | bit;
+            }
+        }
+        
+        // pushes out the pending bytes, the stream is complete afterwards
+        void flush() {
+            for (int i = 0; i < 5; ++i) {
+                shiftLow();
+            }
+        }
+    
+    private:
+        vector<unsigned char>& out;
+        uint64_t low;
+        uint32_t range;
+        unsigned char cache;
+        uint64_t cacheSize;
+        
+        // carry propagation through the run of 0xFF bytes held back in cache
+        void shiftLow() {
+            if (static_cast<uint32_t>(low) < 0xFF000000u || (low >> 32) != 0) {
+                unsigned char carry = static_cast<unsigned char>(low >> 32);
+                unsigned char pending = cache;
+                do {
+                    out.push_back(static_cast<unsigned char>(pending + carry));
+                    pending = 0xFF;
+                } while (--cacheSize != 0);
+                cache = static_cast<unsigned char>(low >> 24);
+            }
+            cacheSize++;
+            low = (low & 0x00FFFFFFu) << 8;
+        }
+};
+
+
+class RangeDecoder {
+    public:
+        RangeDecoder(const unsigned char* data, size_t size): data(data), end(data + size), range(0xFFFFFFFFu), code(0), overrun(0) { // Ctor
+            for (int i = 0; i < 5; ++i) {
+                code = (code << 8) | next();
+            }
+        }
+        
+        int decodeBit(BitModel& model) {
+            uint32_t bound = (range >> BIT_MODEL_BITS) * model;
+            int bit;
+            if (code < bound) {
+                range = bound;
+                model += ((1 << BIT_MODEL_BITS) - model) >> BIT_MODEL_SHIFT;
+                bit = 0;
+            } else {
+                code -= bound;
+                range -= bound;
+                model -= model >> BIT_MODEL_SHIFT;
+                bit = 1;
+            }
+            while (range < RANGE_TOP) {
+                range <<= 8;
+                code = (code << 8) | next();
+            }
+            return bit;
+        }
+        
+        uint32_t decodeTree(BitModel* models, int bits) {
+            uint32_t context = 1;
+            for (int i = 0; i < bits; ++i) {
+                context = (context << 1) | decodeBit(models[context]);
+            }
+            return context - (1u << bits);
+        }
+        
+        // a stream read past its end was truncated or corrupt (the flush leaves 4 bytes of slack)
+        bool overran() const { return overrun > 4; }
+    
+    private:
+        const unsigned char* data;
+        const unsigned char* end;
+        uint32_t range;
+        uint32_t code;
+        size_t overrun;
+        
+        unsigned char next() {
+            if (data < end) {
+                return *data++;
+            }
+            overrun++;
+            return 0;
+        }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef _SIZE_PREDICTOR_HPP
+#define _SIZE_PREDICTOR_HPP
+
+
+// include lib files
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// include header files
+#include "QuadTree.hpp"
+
+
+// namespace
+using namespace std;
+
+
+// What the encoders see of a rendered tree: every leaf is one run on each row it covers
+// (row runs) and on each column (column runs), the row filters and the deflate / DCT
+// stages pay mostly per color change. Leaf sizes enter only through these sums, and
+// neighbours of equal color are still counted as separate runs
+struct TreeFeatures {
+    uint64_t rowRuns;    // sum of leaf heights
+    uint64_t columnRuns; // sum of leaf widths
+};
+
+
+// Encoded size model calibrated per image: real encodes are stored as samples and other
+// trees are predicted by log-log interpolation on their run count between the nearest
+// samples (extrapolated with the slope of the two outermost ones).
+class SizePredictor {
+    public:
+        SizePredictor() = default; // Ctor
+        ~SizePredictor() = default; // Dtor
+        
+        static TreeFeatures measure(const QuadTree& tree);
+        
+        void addSample(const TreeFeatures& features, size_t encodedBytes);
+        void clear() { samples.clear(); }
+        
+        // Needs two samples with different run counts
+        bool ready() const { return samples.size() >= 2; }
+        size_t predict(const TreeFeatures& features) const;
+    
+    private:
+        struct Sample {
+            double logRuns;
+            double logBytes;
+        };
+        vector<Sample> samples; // sorted by run count
+        
+        static double logRuns(const TreeFeatures& features);
+};
+
+#endif
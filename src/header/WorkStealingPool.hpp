@@ -0,0 +1,74 @@
+#ifndef _WORK_STEALING_POOL_HPP
+#define _WORK_STEALING_POOL_HPP
+
+
+// include lib files
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <exception>
+#include <functional>
+#include <condition_variable>
+
+
+// namespace
+using namespace std;
+
+
+// Fork-join pool with one task deque per worker. Owners push and pop at the back (depth
+// first, cache warm), idle threads steal from the front of other deques (the oldest,
+// usually largest tasks). A thread waiting on a group runs only that group's queued tasks
+// and sleeps while the rest of the group runs elsewhere. Groups waited on from inside a
+// task belong to that task, so nested spawn/wait cannot deadlock.
+class WorkStealingPool {
+    public:
+        // Completion counter for a set of spawned tasks
+        class TaskGroup {
+            public:
+                TaskGroup(): pending(0) {} // Ctor
+                
+            private:
+                friend class WorkStealingPool;
+                atomic<int> pending;
+                mutex errorLock;
+                exception_ptr error;
+                mutex doneLock;
+                condition_variable done; // pending reached 0
+        };
+        
+        explicit WorkStealingPool(unsigned threadCount); // Ctor, threadCount includes the waiting thread
+        ~WorkStealingPool(); // Dtor
+        
+        unsigned getThreadCount() const { return static_cast<unsigned>(workers.size()) + 1; }
+        
+        void spawn(TaskGroup& group, function<void()> task);
+        void wait(TaskGroup& group); // rethrows the first exception thrown by a task of the group
+        
+    private:
+        struct Task {
+            function<void()> run;
+            TaskGroup* group;
+        };
+        
+        struct Queue {
+            mutex lock;
+            deque<Task> tasks;
+        };
+        
+        vector<unique_ptr<Queue>> queues; // one per worker, the last one is shared by outside threads
+        vector<thread> workers;
+        atomic<bool> stopping;
+        atomic<int> queued;
+        mutex sleepLock;
+        condition_variable wakeUp;
+        
+        size_t homeQueue() const;
+        bool runOne(size_t home, const TaskGroup* only);
+        void execute(Task& task);
+        void workerLoop(size_t index);
+};
+
+#endif